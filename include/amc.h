@@ -11,8 +11,27 @@
 #include "utils.h"
 #include <unistd.h>
 
+/*! \struct fwCapabilities
+ *  Firmware capabilities of the card. Read once per process and address table generation, see getFwCapabilities
+ */
+struct fwCapabilities {
+    uint32_t generation; /*!< Address table generation the descriptor was read with, 0 if not read */
+    uint32_t major; /*!< GEM_AMC.GEM_SYSTEM.RELEASE.MAJOR, 1 for v2b and 3 for v3 electronics */
+    uint32_t minor; /*!< GEM_AMC.GEM_SYSTEM.RELEASE.MINOR */
+    uint32_t build; /*!< GEM_AMC.GEM_SYSTEM.RELEASE.BUILD */
+    uint32_t numOfOH; /*!< GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH */
+    bool hasAdcCached; /*!< The VFAT3 ADC0_CACHED and ADC1_CACHED registers exist */
+    bool hasVfatBroadcast; /*!< The v3 optohybrids expose a GEB.VFAT_BROADCAST node, writing to all their VFATs in one slow control transaction */
+};
+
+/*! \fn const fwCapabilities & getFwCapabilities(localArgs *la)
+ *  \brief Returns the firmware capabilities, reading them with one memhub batch if the address table changed since the last call
+ *  \param la Local arguments structure
+ */
+const fwCapabilities & getFwCapabilities(localArgs *la);
+
 /*! \fn unsigned int fw_version_check(const char* caller_name, localArgs *la)
- *  \brief Returns AMC FW version
+ *  \brief Returns AMC FW version, from the cached firmware capabilities
  *  in case FW version is not 1.X or 3.X sets an error string in response
  *  \param caller_name Name of methods which called the FW version check
  *  \param la Local arguments structure
@@ -63,4 +82,115 @@ std::vector<uint32_t> sbitReadOutLocal(localArgs *la, uint32_t ohN, uint32_t acq
  */
 void sbitReadOut(const RPCMsg *request, RPCMsg *response);
 
+/*! \struct sbitMonitorRegs
+ *  Raw addresses of the SBIT Monitor registers, resolved once so that a readout loop does not need the address table
+ */
+struct sbitMonitorRegs {
+    uint32_t reset; /*!< GEM_AMC.TRIGGER.SBIT_MONITOR.RESET */
+    uint32_t l1aDelay; /*!< GEM_AMC.TRIGGER.SBIT_MONITOR.L1A_DELAY */
+    uint32_t cluster[8]; /*!< GEM_AMC.TRIGGER.SBIT_MONITOR.CLUSTERi */
+};
+
+/*! \fn bool setupSbitMonitorLocal(localArgs *la, uint32_t ohN, sbitMonitorRegs & regs)
+ *  \brief Selects optohybrid ohN in the SBIT Monitor, takes the VFATs out of slow control only mode and resolves the SBIT Monitor registers
+ *  \param la Local arguments structure
+ *  \param ohN Optical link
+ *  \param regs Resolved SBIT Monitor registers
+ *  \return false if a register is not found
+ */
+bool setupSbitMonitorLocal(localArgs *la, uint32_t ohN, sbitMonitorRegs & regs);
+
+/*! \fn int readSbitMonitor(const sbitMonitorRegs & regs, uint32_t *clusters)
+ *  \brief Resets the SBIT Monitor, waits 4095 clock cycles and reads the L1A delay and the 8 clusters with one memhub batch.
+ *          Does not use the address table nor the RPC response, so it can run outside of an RPC method
+ *  \param regs SBIT Monitor registers
+ *  \param clusters 8 words in the format of the sbitReadOutLocal output
+ *  \return Number of valid clusters, -1 if the SBIT Monitor could not be read
+ */
+int readSbitMonitor(const sbitMonitorRegs & regs, uint32_t *clusters);
+
+/*! \fn bool sbitMonitorAcquireLocal(RPCMsg *response, const char *user)
+ *  \brief Claims the SBIT Monitor for this process. All the users of the GEM_AMC.TRIGGER.SBIT_MONITOR registers (sbitReadOut, the streaming readout,
+ *          the SBIT histogramming worker and checkSbitMappingWithCalPulse) claim it first, so that they cannot corrupt each other's data
+ *  \param response RPC response message, "error" is set if the SBIT Monitor is used
+ *  \param user Name reported to the other users
+ *  \return false if another process, another user of this process or the histogramming worker uses the SBIT Monitor
+ */
+bool sbitMonitorAcquireLocal(RPCMsg *response, const char *user);
+
+/*! \fn void sbitMonitorReleaseLocal()
+ *  \brief Releases the SBIT Monitor claimed by this process with sbitMonitorAcquireLocal
+ */
+void sbitMonitorReleaseLocal();
+
+/*! \class sbitMonitorGuard
+ *  Claims the SBIT Monitor in scope, see sbitMonitorAcquireLocal
+ */
+class sbitMonitorGuard {
+    public:
+        sbitMonitorGuard(RPCMsg *response, const char *user) : held(sbitMonitorAcquireLocal(response, user)) {}
+        ~sbitMonitorGuard() { if (held) sbitMonitorReleaseLocal(); }
+
+        /*! \brief True if the SBIT Monitor may be used */
+        bool locked() const { return held; }
+
+    private:
+        bool held;
+};
+
+/*! \fn void sbitReadOutStart(const RPCMsg *request, RPCMsg *response)
+ *  \brief Starts a streaming SBIT readout of optohybrid "ohN" for "acquireTime" seconds (0: until sbitReadOutStop).
+ *  \details The SBIT Monitor is read by a background thread of the RPC process into a ring buffer of "bufferSize" words (default 1M words, at most 16M words),
+ *            in the sbitReadOutLocal format, and fetched with sbitReadOutFetch while the acquisition goes on. Unlike sbitReadOut there is no size limit.
+ *            The thread belongs to the process of the client connection: the acquisition ends when the connection closes, and sbitReadOutFetch
+ *            and sbitReadOutStop only work from the same connection. Use sbitMonitorStart for an acquisition that outlives the connection.
+ *            The SBIT Monitor is claimed until the acquisition ends, see sbitMonitorAcquireLocal
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void sbitReadOutStart(const RPCMsg *request, RPCMsg *response);
+
+/*! \fn void sbitReadOutFetch(const RPCMsg *request, RPCMsg *response)
+ *  \brief Returns up to "maxWords" (default 16000) words of the streaming SBIT readout from "cursor" (0 for the first call) in "storedSbits".
+ *  \details "cursor" of the response is the cursor of the next fetch. It is a position in the stream modulo 2^32: pass back the returned value
+ *            unchanged, a fetch then resumes correctly after the stream wraps past 2^32 words. Words overwritten in the ring buffer before being fetched are skipped
+ *            and counted in "lostWords" ("totalLostWords" since the start), both saturating at 2^32-1. Also returns "running", "approxLiveTime" and "readErrors".
+ *            Only works from the connection which started the readout
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void sbitReadOutFetch(const RPCMsg *request, RPCMsg *response);
+
+/*! \fn void sbitReadOutStop(const RPCMsg *request, RPCMsg *response)
+ *  \brief Stops the streaming SBIT readout of this connection. Words already acquired can still be fetched. Sets "error" if no readout is running
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void sbitReadOutStop(const RPCMsg *request, RPCMsg *response);
+
+/*! \fn void sbitMonitorStart(const RPCMsg *request, RPCMsg *response)
+ *  \brief Starts the SBIT histogramming of optohybrid "ohN" for "acquireTime" seconds (0: until sbitMonitorStop).
+ *  \details The SBIT Monitor is read by a detached worker process, which keeps running when the client disconnects,
+ *            and accumulates the histograms in shared memory. Only one worker runs per card, and it does not start while another user holds the
+ *            SBIT Monitor, see sbitMonitorAcquireLocal
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void sbitMonitorStart(const RPCMsg *request, RPCMsg *response);
+
+/*! \fn void sbitMonitorPoll(const RPCMsg *request, RPCMsg *response)
+ *  \brief Returns the SBIT histograms: "vfatHits" (24), "sbitHits" (24x64, VFAT major), "clusterSizeHist" (8) and "l1aDelayHist" (4096, one entry per readout with a valid cluster),
+ *          plus "running", "ohN", "approxLiveTime", "readouts" and "readErrors". The histograms are cleared if "reset" is set
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void sbitMonitorPoll(const RPCMsg *request, RPCMsg *response);
+
+/*! \fn void sbitMonitorStop(const RPCMsg *request, RPCMsg *response)
+ *  \brief Stops the SBIT histogramming worker. The histograms can still be polled
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void sbitMonitorStop(const RPCMsg *request, RPCMsg *response);
+
 #endif
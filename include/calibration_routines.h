@@ -192,7 +192,7 @@ void ttcGenConf(const RPCMsg *request, RPCMsg *response);
  *  \param dacStep Scan variable change step
  *  \param scanReg DAC register to scan over name
  *  \param useUltra Set to 1 in order to use the ultra scan
- *  \param useExtTrig Set to 1 in order to use the backplane triggers
+ *  \param useExtTrig Set to 1 in order to use the backplane triggers; the scan fails if nevts of them do not arrive within 5 min for a DAC value
  */
 void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useUltra, bool useExtTrig);
 
@@ -203,6 +203,36 @@ void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask,
  */
 void genScan(const RPCMsg *request, RPCMsg *response);
 
+/*! \fn void genScanMultiLinkLocal(localArgs *la, uint32_t *outData, uint32_t ohMask, const uint32_t *ohVfatMasks, uint32_t NOH, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useExtTrig)
+ *  \brief genScanLocal of several optohybrids. The links are checked and configured once, the scan register is written on all links
+ *          for each DAC value, then each link is triggered and its VFAT_DAQ_MONITOR counters are read in one batch. Only supported in V3 electronics
+ *  \param la Local arguments structure
+ *  \param outData Pointer to output data array, NOH blocks of 24*(dacMax-dacMin+1)/dacStep words in the layout of genScanLocal
+ *  \param ohMask Mask of the optohybrids to scan, a set bit is scanned
+ *  \param ohVfatMasks VFAT mask of each optohybrid, indexed by ohN
+ *  \param NOH Number of optohybrids of the card
+ *  \param ch Channel of interest, 128 for the OR of all channels
+ *  \param useCalPulse Use calibration pulse if true
+ *  \param currentPulse Selects whether to use current or volage pulse
+ *  \param calScaleFactor Scale factor for the calibration pulse height (00 = 25%, 01 = 50%, 10 = 75%, 11 = 100%)
+ *  \param nevts Number of events per calibration point
+ *  \param dacMin Minimal value of scan variable
+ *  \param dacMax Maximal value of scan variable
+ *  \param dacStep Scan variable change step
+ *  \param scanReg DAC register to scan over name
+ *  \param useExtTrig Use external triggers instead of the TTC generator, at most 5 min are waited for the nevts triggers of a DAC value and link
+ */
+void genScanMultiLinkLocal(localArgs *la, uint32_t *outData, uint32_t ohMask, const uint32_t *ohVfatMasks, uint32_t NOH, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useExtTrig);
+
+/*! \fn void genScanMultiLink(const RPCMsg *request, RPCMsg *response)
+ *  \brief Generic calibration routine on all optohybrids of "ohMask". Takes the parameters of genScan except ohN and mask; the VFAT masks are
+ *          read from the optohybrids unless given in the 12 words of "ohVfatMaskArray". "NOH" optionally limits the number of links.
+ *          Returns "data" with one block of results per link
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void genScanMultiLink(const RPCMsg *request, RPCMsg *response);
+
 /*! \fn void sbitRateScanLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outDataTrigRate, uint32_t ohN, uint32_t maskOh, bool invertVFATPos, uint32_t ch, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, uint32_t waitTime)
  *  \brief SBIT rate scan. Local version of sbitRateScan
  *
@@ -282,7 +312,8 @@ void sbitRateScan(const RPCMsg *request, RPCMsg *response);
 void checkSbitMappingWithCalPulseLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t vfatN, uint32_t mask, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t L1Ainterval, uint32_t pulseDelay);
 
 /*! \fn void checkSbitMappingWithCalPulse(const RPCMsg *request, RPCMsg *response)
- *  \brief Checks the sbit mapping using the calibration pulse. See the local callable methods documentation for details
+ *  \brief Checks the sbit mapping using the calibration pulse. See the local callable methods documentation for details.
+ *          Returns an error while another user holds the SBIT Monitor, see sbitMonitorAcquireLocal
  *  \param request RPC response message
  *  \param response RPC response message
  */
@@ -313,7 +344,7 @@ void checkSbitRateWithCalPulseLocal(localArgs *la, uint32_t *outDataCTP7Rate, ui
  */
 void checkSbitRateWithCalPulse(const RPCMsg *request, RPCMsg *response);
 
-/*! \fn std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSelect, uint32_t dacStep=1, uint32_t mask=0xFF000000, bool useExtRefADC=false)
+/*! \fn std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSelect, uint32_t dacStep=1, uint32_t mask=0xFF000000, bool useExtRefADC=false, uint32_t nReads=100, uint32_t adcTolerance=0)
  *  \brief configures the VFAT3 DAC Monitoring and then scans the DAC and records the measured ADC values for all unmasked VFATs
  *  \param la Local arguments structure
  *  \param ohN Optical link
@@ -321,12 +352,15 @@ void checkSbitRateWithCalPulse(const RPCMsg *request, RPCMsg *response);
  *  \param dacStep step size to scan the dac in
  *  \param mask VFAT mask to use, a value of 1 in the N^th bit indicates the N^th VFAT is masked
  *  \param useExtRefADC if (true) false use the (externally) internally referenced ADC on the VFAT3 for monitoring
+ *  \param nReads number of ADC reads averaged for each DAC value
+ *  \param adcTolerance if non-zero, a VFAT is not read anymore for the current DAC value once twice the standard error of its mean ADC value is at most adcTolerance counts (after at least 8 reads)
  *  \return Returns a std::vector<uint32_t> object of size 24*(dacMax-dacMin+1)/dacStep where dacMax and dacMin are described in the VFAT3 manual.  For each element bits [7:0] are the dacValue, bits [17:8] are the ADC readback value in either current or voltage units depending on dacSelect (again, see VFAT3 manual), bits [22:18] are the VFAT position, and bits [26:23] are the optohybrid number.
  */
-std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSelect, uint32_t dacStep=1, uint32_t mask=0xFF000000, bool useExtRefADC=false);
+std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSelect, uint32_t dacStep=1, uint32_t mask=0xFF000000, bool useExtRefADC=false, uint32_t nReads=100, uint32_t adcTolerance=0);
 
 /*! \fn void dacScan(const RPCMsg *request, RPCMsg *response)
  *  \brief allows the host machine to perform a dacScan for all unmasked VFATs on a given optohybrid, see Local version for details.
+ *  \details The optional "nReads" (default 100) and "adcTolerance" (default 0) words are passed to dacScanLocal, also by dacScanMultiLink
  *  \param request rpc request message
  *  \param response rpc responce message
  */
@@ -347,4 +381,84 @@ void dacScanMultiLink(const RPCMsg *request, RPCMsg *response);
  */
 void genChannelScan(const RPCMsg *request, RPCMsg *response);
 
+/*! \struct scanJobLoop
+ *  Progress of a scan loop, reported to the scan job running the scan. Nested loops subdivide the current step of the enclosing loop.
+ *  Does nothing when the scan is not run by a scan job
+ */
+struct scanJobLoop {
+    /*! \fn scanJobLoop(uint32_t total)
+     *  \brief Enters a loop of total steps
+     */
+    scanJobLoop(uint32_t total);
+
+    /*! \fn ~scanJobLoop()
+     *  \brief Leaves the loop
+     */
+    ~scanJobLoop();
+
+    /*! \fn bool step(uint32_t done, uint32_t dacVal, uint32_t channel)
+     *  \brief Reports that done steps of the loop are completed and the current DAC value and channel
+     *  \return false if the scan job was cancelled: the scan leaves its loop and restores the hardware as after its last step
+     */
+    bool step(uint32_t done, uint32_t dacVal, uint32_t channel);
+
+    /*! \fn bool outermost() const
+     *  \brief True if the loop is not nested in another scan loop, i.e. its results are the results of the job
+     */
+    bool outermost() const { return depth == 0; }
+
+    int depth; /*!< Nesting depth of the loop */
+};
+
+/*! \fn void scanJobPartial(const uint32_t *data, uint32_t count)
+ *  \brief Publishes the partial results of the scan, fetched with fetchScanJob while the job runs. Does nothing outside of scan jobs
+ *  \param data Result words, in the layout of the final result
+ *  \param count Number of words
+ */
+void scanJobPartial(const uint32_t *data, uint32_t count);
+
+/*! \fn bool scanJobCancelRequested()
+ *  \brief True if this process is a scan job worker whose job was cancelled, for waits which do not go through a scanJobLoop step
+ */
+bool scanJobCancelRequested();
+
+/*! \fn void submitScanJob(const RPCMsg *request, RPCMsg *response)
+ *  \brief Runs a scan in a detached worker process and returns its "jobId" immediately
+ *  \details "scanMethod" names the scan (genScan, genScanMultiLink, genChannelScan, sbitRateScan, dacScan, dacScanMultiLink, checkSbitMappingWithCalPulse or checkSbitRateWithCalPulse),
+ *            the other words of the request are its parameters. Jobs are executed one at a time, as they share the TTC generator
+ *            and the DAQ monitor; the synchronous scan RPCs return an error while a job or another scan uses them.
+ *            The worker keeps running when the client disconnects. At most 16 jobs are kept: a finished job keeps its slot until
+ *            it is released with fetchScanJob, or for a day, and an error is returned when no slot is left
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void submitScanJob(const RPCMsg *request, RPCMsg *response);
+
+/*! \fn void pollScanJob(const RPCMsg *request, RPCMsg *response)
+ *  \brief Returns the "state" of job "jobId" (1 queued, 2 running, 3 done, 4 failed, 5 cancelled), its "progress" in parts per million,
+ *          the current "dacVal" and "channel", "partialWords" and "elapsedTime". "error" is set if the job failed
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void pollScanJob(const RPCMsg *request, RPCMsg *response);
+
+/*! \fn void fetchScanJob(const RPCMsg *request, RPCMsg *response)
+ *  \brief Returns the poll information of job "jobId" and its results. Once the job is done "result" holds the serialized response
+ *          of the scan method, otherwise "partialData" holds the last published partial results. The job is forgotten if "release" is set
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void fetchScanJob(const RPCMsg *request, RPCMsg *response);
+
+/*! \fn void cancelScanJob(const RPCMsg *request, RPCMsg *response)
+ *  \brief Cancels job "jobId" and returns its poll information. The scan stops at its next loop step, restores the hardware as at the end
+ *         of a scan, and the job becomes cancelled; poll it to see when. A job which finished in the meantime keeps its state and results.
+ *  \details If the job still runs 60 s after the first request, a new request terminates its worker with SIGTERM, then SIGKILL,
+ *            and leaves the hardware in the state the scan had reached. The job is then marked as cancelled once the worker exited,
+ *            otherwise an error is returned
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void cancelScanJob(const RPCMsg *request, RPCMsg *response);
+
 #endif
@@ -0,0 +1,91 @@
+/*! \file hw_policy.h
+ *  \brief Hardware generation policies of the v2b and v3 electronics
+ *  \details The register layouts of the two generations are described at compile time, so that routines templated on
+ *           a policy are instantiated once per generation and do not branch on the firmware version in their loops.
+ *           withFwPolicy is the single runtime dispatch point.
+ */
+
+#ifndef HW_POLICY_H
+#define HW_POLICY_H
+
+#include "amc.h"
+#include <string>
+
+/*! \struct V2bPolicy
+ *  Register layout and broadcast strategy of the v2b electronics (GEM_SYSTEM.RELEASE.MAJOR 1)
+ */
+struct V2bPolicy {
+    static constexpr uint32_t fwMajor = 1;
+    static constexpr const char * name() { return "v2b"; }
+    static constexpr const char * vfatNode() { return "GEB.VFATS.VFAT"; } /*!< VFAT node relative to GEM_AMC.OH.OHx */
+    static constexpr const char * channelNode() { return "VFATChannels.ChanReg"; } /*!< Channel register relative to the VFAT node */
+    static constexpr const char * runModeReg() { return "ContReg0"; }
+    static constexpr uint32_t runModeOn = 0x37;
+    static constexpr uint32_t runModeOff = 0x36;
+
+    /*! \fn void broadcastWrite(localArgs * la, uint32_t ohN, const std::string & regName, uint32_t value, uint32_t mask)
+     *  \brief Writes regName of the unmasked VFATs with the OH broadcast module
+     */
+    static void broadcastWrite(localArgs * la, uint32_t ohN, const std::string & regName, uint32_t value, uint32_t mask);
+};
+
+/*! \struct V3Policy
+ *  Register layout and broadcast strategy of the v3 electronics (GEM_SYSTEM.RELEASE.MAJOR 3)
+ */
+struct V3Policy {
+    static constexpr uint32_t fwMajor = 3;
+    static constexpr const char * name() { return "v3"; }
+    static constexpr const char * vfatNode() { return "GEB.VFAT"; }
+    static constexpr const char * channelNode() { return "VFAT_CHANNELS.CHANNEL"; }
+    static constexpr const char * runModeReg() { return "CFG_RUN"; }
+    static constexpr uint32_t runModeOn = 0x1;
+    static constexpr uint32_t runModeOff = 0x0;
+
+    /*! \fn void broadcastWrite(localArgs * la, uint32_t ohN, const std::string & regName, uint32_t value, uint32_t mask)
+     *  \brief Writes regName of the unmasked VFATs
+     */
+    static void broadcastWrite(localArgs * la, uint32_t ohN, const std::string & regName, uint32_t value, uint32_t mask);
+};
+
+/*! \fn std::string vfatRegName(uint32_t ohN, uint32_t vfatN, const std::string & regName)
+ *  \brief Returns the full name of register regName of VFAT vfatN on optohybrid ohN
+ */
+template<typename Policy>
+std::string vfatRegName(uint32_t ohN, uint32_t vfatN, const std::string & regName)
+{
+    return stdsprintf("GEM_AMC.OH.OH%i.%s%i.%s", ohN, Policy::vfatNode(), vfatN, regName.c_str());
+}
+
+/*! \fn std::string channelRegName(uint32_t ohN, uint32_t vfatN, uint32_t chan, const std::string & regName = "")
+ *  \brief Returns the full name of the channel register chan of VFAT vfatN on optohybrid ohN, or of its field regName
+ */
+template<typename Policy>
+std::string channelRegName(uint32_t ohN, uint32_t vfatN, uint32_t chan, const std::string & regName = "")
+{
+    return stdsprintf("GEM_AMC.OH.OH%i.%s%i.%s%i%s", ohN, Policy::vfatNode(), vfatN, Policy::channelNode(), chan,
+            regName.empty() ? "" : ("."+regName).c_str());
+}
+
+/*! \fn bool withFwPolicy(localArgs * la, const char * caller, Func && func)
+ *  \brief Calls func with the policy of the firmware of the card, e.g. withFwPolicy(la, "caller", [&](auto policy){ f<decltype(policy)>(la); })
+ *  \param la Local arguments structure
+ *  \param caller Name of the calling method, reported if the firmware version is unexpected
+ *  \param func Generic callable taking the policy by value
+ *  \return false if the firmware version is unexpected, an error is then set in the response
+ */
+template<typename Func>
+bool withFwPolicy(localArgs * la, const char * caller, Func && func)
+{
+    switch (fw_version_check(caller, la)) {
+        case V2bPolicy::fwMajor:
+            func(V2bPolicy());
+            return true;
+        case V3Policy::fwMajor:
+            func(V3Policy());
+            return true;
+        default:
+            return false;
+    }
+}
+
+#endif
@@ -10,8 +10,71 @@ extern "C" {
 #endif
 
 /*
- * This library is a thin wrapper around libmemsvc, which adds semaphores to synchronize concurrent read/write operations from different processes.
+ * This library is a thin wrapper around libmemsvc, which adds locks to synchronize concurrent read/write operations from different processes.
+ *
+ * The address space is split in blocks of (1 << MEMHUB_STRIPE_SHIFT) bytes, block b being guarded by stripe b % MEMHUB_STRIPES,
+ * a robust process-shared mutex in the shared memory segment /dev/shm/memhub_locks. Accesses to different stripes proceed concurrently,
+ * accesses spanning several stripes take them in ascending order. An access whose stripes cannot be locked is not done and fails.
+ */
+#define MEMHUB_STRIPES 32
+#define MEMHUB_STRIPE_SHIFT 16
+
+/* Stripe locks are robust process-shared mutexes: if the owner dies, even by SIGKILL, the next client recovers the lock.
+ * A client waiting for more than MEMHUB_LEASE_US on a live owner logs a warning with the owner pid and keeps waiting.
  */
+#define MEMHUB_LEASE_US 1000000
+
+typedef struct memhub_lock_stats {
+    uint64_t acquisitions;      /* number of times the stripe was locked */
+    uint64_t contended;         /* acquisitions which had to wait for another owner */
+    uint64_t recoveries;        /* acquisitions which recovered the lock of a dead owner */
+    uint64_t lease_expirations; /* waits which exceeded MEMHUB_LEASE_US */
+    uint64_t max_hold_ns;       /* longest time the stripe was held */
+    uint64_t total_hold_ns;     /* sum of the hold times */
+    uint32_t owner;             /* pid of the current owner, 0 if free. Only filled by memhub_get_lock_stats */
+} memhub_lock_stats;
+
+/* Returns 0 on success and -1 if the stripe does not exist or memhub was not opened */
+int memhub_get_lock_stats(uint32_t stripe, memhub_lock_stats *stats);
+void memhub_reset_lock_stats();
+
+/* Access statistics.
+ *
+ * Every process using memhub owns a slot of /dev/shm/memhub_stats in which it records, without locking,
+ * histograms of the time spent waiting for the stripe locks, holding them and inside memsvc, and per caller access counters.
+ * Histogram buckets are log-linear in nanoseconds with 4 buckets per power of two, see memhub_hist_bucket_ns.
+ * Accesses are attributed to the name set by memhub_set_caller for the calling thread, or to the library calling memhub otherwise.
+ */
+#define MEMHUB_STATS_SLOTS 64
+#define MEMHUB_HIST_BUCKETS 160
+#define MEMHUB_MAX_CALLERS 16
+#define MEMHUB_CALLER_NAME_SIZE 32
+
+typedef struct memhub_caller_stats {
+    char name[MEMHUB_CALLER_NAME_SIZE];
+    uint64_t reads;   /* words read */
+    uint64_t writes;  /* words written */
+    uint64_t calls;   /* memhub_read, memhub_write and memhub_batch calls */
+    uint64_t wait_ns; /* time spent waiting for the stripe locks */
+} memhub_caller_stats;
+
+typedef struct memhub_process_stats {
+    uint32_t pid;
+    uint32_t wait_hist[MEMHUB_HIST_BUCKETS];   /* lock acquisition time per call */
+    uint32_t hold_hist[MEMHUB_HIST_BUCKETS];   /* lock hold time per call */
+    uint32_t memsvc_hist[MEMHUB_HIST_BUCKETS]; /* duration of each memsvc access, a read-modify-write of a batch counts as one */
+    memhub_caller_stats callers[MEMHUB_MAX_CALLERS];
+} memhub_process_stats;
+
+/* Attributes the following accesses of the calling thread to name, NULL to go back to the calling library */
+void memhub_set_caller(const char *name);
+/* Returns 0 and copies the statistics of a slot, -1 if the slot is unused */
+int memhub_get_process_stats(uint32_t slot, memhub_process_stats *stats);
+/* Clears the histograms and counters of all the processes */
+void memhub_reset_stats();
+/* Lower bound of a histogram bucket in ns */
+uint64_t memhub_hist_bucket_ns(uint32_t bucket);
+
 int memhub_open(memsvc_handle_t *handle);
 int memhub_close(memsvc_handle_t *handle);
 
@@ -21,6 +84,59 @@ int memhub_close(memsvc_handle_t *handle);
  */
 int memhub_read(memsvc_handle_t handle, uint32_t addr, uint32_t words, uint32_t *data);
 int memhub_write(memsvc_handle_t handle, uint32_t addr, uint32_t words, const uint32_t *data);
+/* Reads words values from the same address, e.g. to drain a FIFO, with a single acquisition of its stripe.
+ * memsvc bursts always increment the address, so the words are read one at a time, but other clients cannot interleave with the drain.
+ * Stops at the first error.
+ */
+int memhub_read_fifo(memsvc_handle_t handle, uint32_t addr, uint32_t words, uint32_t *data);
+
+/* Batched register transactions.
+ *
+ * A batch is a list of single word operations executed in order with one acquisition of the stripes it touches,
+ * so that e.g. a status dump does not pay a lock round per register.
+ * MEMHUB_RMW replaces the bits of mask with the corresponding bits of value, the read and the write are never separated.
+ * If max_hold_us is not 0 the stripes are released and acquired again between two operations once they have been held
+ * for that long, so that other processes are not starved by a long batch.
+ */
+#define MEMHUB_READ 0
+#define MEMHUB_WRITE 1
+#define MEMHUB_RMW 2
+
+#define MEMHUB_DEFAULT_MAX_HOLD_US 1000
+
+typedef struct memhub_op {
+    uint32_t type;  /* MEMHUB_READ, MEMHUB_WRITE or MEMHUB_RMW */
+    uint32_t addr;  /* register address */
+    uint32_t value; /* value to write, value read back for MEMHUB_READ, value written for MEMHUB_RMW */
+    uint32_t mask;  /* bits to modify, only used by MEMHUB_RMW */
+    int status;     /* set to 0 on success and -1 on error */
+} memhub_op;
+
+/* Returns the number of failed operations. Failed operations do not stop the batch, but a failure to lock the stripes
+ * fails all the operations not executed yet.
+ */
+int memhub_batch(memsvc_handle_t handle, memhub_op *ops, uint32_t nops, uint32_t max_hold_us);
+
+/* Merges in place consecutive writes and read-modify-writes of a batch hitting the same word, any other access in between stops the merge,
+ * so no access is reordered. Repeated writes to a word are still collapsed into one, which is wrong for FIFO or command ports.
+ * A merged operation is a MEMHUB_WRITE once its masks cover the whole word. The order of the remaining operations is kept.
+ * index[i] receives the position of the operation which executes ops[i]. Returns the number of remaining operations.
+ */
+uint32_t memhub_merge_ops(memhub_op *ops, uint32_t nops, uint32_t *index);
+
+/* Block of consecutive words read by memhub_read_runs */
+typedef struct memhub_run {
+    uint32_t addr;   /* address of the first word */
+    uint32_t words;  /* number of consecutive words */
+    uint32_t *data;  /* destination of the words */
+    int status;      /* set to 0 on success and -1 on error */
+} memhub_run;
+
+/* Reads several blocks of consecutive words, each with a single memsvc_read, with one acquisition of the stripes they touch.
+ * max_hold_us has the same meaning as for memhub_batch. Returns the number of failed runs, a failure to lock the stripes
+ * fails all the runs not read yet.
+ */
+int memhub_read_runs(memsvc_handle_t handle, memhub_run *runs, uint32_t nruns, uint32_t max_hold_us);
 void die(int signo);
 
 #ifdef __cplusplus
@@ -10,6 +10,7 @@
 #include "utils.h"
 #include "vfat_parameters.h"
 #include <unistd.h>
+#include <vector>
 
 /*! \fn void biasAllVFATsLocal(localArgs * la, uint32_t ohN, uint32_t mask = 0xFF000000)
  *  \brief Local callable. Sets default values to VFAT parameters. VFATs will remain in sleep mode
@@ -47,6 +48,25 @@ void broadcastWrite(const RPCMsg *request, RPCMsg *response);
  */
 void broadcastReadLocal(localArgs * la, uint32_t *outData, uint32_t ohN, std::string regName, uint32_t mask = 0xFF000000);
 
+/*! \fn bool broadcastReadMultiLocal(localArgs * la, uint32_t *outData, uint32_t ohMask, const std::vector<std::string> & regNames, const uint32_t *vfatMasks = NULL)
+ *  \brief Reads several registers of all the VFATs of several optohybrids with one memhub batch
+ *  \param la Local arguments structure
+ *  \param outData Dense [reg][oh][vfat] array of regNames.size()*12*24 words. Masked optohybrids and VFATs give 0, failed reads 0xdeaddead
+ *  \param ohMask Bit mask of the optohybrids to read
+ *  \param regNames VFAT register names, e.g. {"CFG_VREF_ADC", "CFG_MON_GAIN"}
+ *  \param vfatMasks VFAT mask of each of the 12 optohybrids. Default: no chips will be masked
+ *  \return false if a register is not found
+ */
+bool broadcastReadMultiLocal(localArgs * la, uint32_t *outData, uint32_t ohMask, const std::vector<std::string> & regNames, const uint32_t *vfatMasks = NULL);
+
+/*! \fn void broadcastReadMulti(const RPCMsg *request, RPCMsg *response)
+ *  \brief Reads the registers "reg_names" of all the VFAT chips of the optohybrids in "ohMask" (masked with the optional 12 word "vfatMasks")
+ *          and returns them in "data", a dense [reg][oh][vfat] array of 12 optohybrids and 24 VFATs per register
+ *  \param request RPC response message
+ *  \param response RPC response message
+ */
+void broadcastReadMulti(const RPCMsg *request, RPCMsg *response);
+
 /*! \fn void broadcastRead(const RPCMsg *request, RPCMsg *response)
  *  \brief Performs broadcast read of a given regiser on all the VFAT chips of a given optohybrid
  *  \param request RPC response message
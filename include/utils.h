@@ -20,6 +20,9 @@
 #include <vector>
 #include <iterator>
 #include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 
 memsvc_handle_t memsvc; /// \var global memory service handle required for registers read/write operations
 
@@ -32,6 +35,36 @@ struct localArgs {
     RPCMsg *response; /*!< RPC response message */
 };
 
+/*! \fn bool openAddressTable()
+ *  \brief Opens the process-lifetime LMDB environment of the address table.
+ *         Does nothing if the environment is already open and the database was not replaced (e.g. by update_address_table) since then.
+ *         Should be called in module_init of every module using the address table
+ *  \return false if the address table could not be opened, it will then be retried on first use
+ */
+bool openAddressTable();
+
+/*! \fn void closeAddressTable()
+ *  \brief Closes the process-lifetime LMDB environment. It will be reopened on the next access
+ */
+void closeAddressTable();
+
+/*! \fn uint32_t getAddressTableGeneration()
+ *  \brief Returns a counter incremented every time the address table is (re)opened. Can be used to invalidate data derived from the address table
+ */
+uint32_t getAddressTableGeneration();
+
+/*! \struct addressTableTxn
+ *  Scoped access to the process-lifetime LMDB environment.
+ *  The cached read-only transaction is renewed on construction and reset on destruction,
+ *  so that an RPC method does not have to create, open and close the environment on every call
+ */
+struct addressTableTxn {
+    addressTableTxn();
+    ~addressTableTxn();
+    lmdb::txn & rtxn; /*!< LMDB transaction handle */
+    lmdb::dbi & dbi; /*!< LMDB individual database handle */
+};
+
 
 template<typename Out>
 void split(const std::string &s, char delim, Out result) {
@@ -48,16 +81,273 @@ std::vector<std::string> split(const std::string &s, char delim) {
     return elems;
 }
 
-std::string serialize(xhal::utils::Node n) {
-  return std::to_string((uint32_t)n.real_address)+"|"+n.permission+"|"+std::to_string((uint32_t)n.mask);
+const uint8_t REG_PERM_READ = 0x1; /// \var regInfo permission bit, register is readable
+const uint8_t REG_PERM_WRITE = 0x2; /// \var regInfo permission bit, register is writable
+const uint16_t REG_INFO_FORMAT = 0xA5C3; /// \var regInfo format marker, not made of ASCII characters so it cannot be confused with a legacy "addr|perm|mask" string
+
+/*! \struct regInfo
+ *  Binary register descriptor stored by update_address_table as LMDB value of every node.
+ *  Lookups read it in place from the LMDB memory map, hence the packed layout
+ */
+struct __attribute__((packed)) regInfo {
+    uint32_t address; /*!< Register address */
+    uint32_t mask; /*!< Register mask */
+    uint8_t shift; /*!< Position of the lowest set bit of the mask */
+    uint8_t perm; /*!< Permission bits, combination of REG_PERM_READ and REG_PERM_WRITE */
+    uint16_t format; /*!< Format marker, always REG_INFO_FORMAT */
+};
+
+regInfo serialize(xhal::utils::Node n) {
+  regInfo info;
+  info.address = (uint32_t)n.real_address;
+  info.mask = (uint32_t)n.mask;
+  info.shift = info.mask ? __builtin_ctz(info.mask) : 0;
+  info.perm = 0;
+  if (n.permission.find('r') != std::string::npos) info.perm |= REG_PERM_READ;
+  if (n.permission.find('w') != std::string::npos) info.perm |= REG_PERM_WRITE;
+  info.format = REG_INFO_FORMAT;
+  return info;
 }
 
+/*! \fn bool parseRegInfo(const lmdb::val & db_res, regInfo & info)
+ *  \brief Decodes an address table LMDB value. Binary descriptors are copied without parsing, databases written in the legacy "addr|perm|mask" format are still understood
+ *  \param db_res LMDB call result
+ *  \param info Decoded register descriptor
+ *  \return false if the value is neither a descriptor nor a legacy string
+ */
+bool parseRegInfo(const lmdb::val & db_res, regInfo & info);
+
+/*! \fn bool getRegInfo(localArgs * la, const std::string & regName, regInfo & info)
+ *  \brief Looks up the descriptor of a given register, in the memory mapped register index written by update_address_table first and in LMDB otherwise
+ *  \param la Local arguments structure
+ *  \param regName Register name
+ *  \param info Register descriptor
+ *  \return false if the register is not found. Error is not reported in the response
+ */
+bool getRegInfo(localArgs * la, const std::string & regName, regInfo & info);
+
+/*! \struct regArray
+ *  Handle on a register replicated with a constant address stride, e.g. the same field of all the VFATs of an optohybrid
+ *  or of all the channels of a VFAT. All elements are looked up once; the descriptors are only kept when the addresses are not evenly spaced
+ */
+struct regArray {
+    regInfo first; /*!< Descriptor of element 0 */
+    uint32_t stride; /*!< Address distance between consecutive elements */
+    uint32_t size; /*!< Number of elements */
+    std::vector<regInfo> elements; /*!< Descriptors of all elements, only filled if the addresses are not evenly spaced */
+
+    /*! \fn regInfo at(uint32_t i) const
+     *  \brief Returns the descriptor of element i
+     */
+    regInfo at(uint32_t i) const {
+        if (!elements.empty()) return elements[i];
+        regInfo info = first;
+        info.address += i*stride;
+        return info;
+    }
+};
+
+/*! \fn bool getRegArray(localArgs * la, const std::string & prefix, uint32_t size, const std::string & suffix, regArray & arr)
+ *  \brief Resolves the registers named prefix+i+suffix for i in [0, size)
+ *  \param la Local arguments structure
+ *  \param prefix Register name up to the index, e.g. "GEM_AMC.OH.OH0.GEB.VFAT"
+ *  \param size Number of elements
+ *  \param suffix Register name after the index, e.g. ".CFG_RUN"
+ *  \param arr Resolved register array
+ *  \return false if one of the registers is not found. The error is set in the response
+ */
+bool getRegArray(localArgs * la, const std::string & prefix, uint32_t size, const std::string & suffix, regArray & arr);
+
+/*! \fn bool getVFATRegArray(localArgs * la, uint32_t ohN, const std::string & regName, regArray & arr)
+ *  \brief Resolves register GEM_AMC.OH.OHohN.GEB.VFATi.regName of the 24 VFATs of an optohybrid
+ *  \param la Local arguments structure
+ *  \param ohN Optohybrid optical link number
+ *  \param regName Register name relative to the VFAT node, e.g. "CFG_RUN"
+ *  \param arr Resolved register array, indexed by VFAT position
+ */
+bool getVFATRegArray(localArgs * la, uint32_t ohN, const std::string & regName, regArray & arr);
+
+/*! \fn bool getChannelRegArray(localArgs * la, uint32_t ohN, uint32_t vfatN, const std::string & regName, regArray & arr)
+ *  \brief Resolves register GEM_AMC.OH.OHohN.GEB.VFATvfatN.VFAT_CHANNELS.CHANNELi.regName of the 128 channels of a VFAT
+ *  \param la Local arguments structure
+ *  \param ohN Optohybrid optical link number
+ *  \param vfatN VFAT position
+ *  \param regName Register name relative to the channel node, e.g. "MASK". Empty string for the full channel register
+ *  \param arr Resolved register array, indexed by channel
+ */
+bool getChannelRegArray(localArgs * la, uint32_t ohN, uint32_t vfatN, const std::string & regName, regArray & arr);
+
+/*! \struct regBatch
+ *  Queue of register reads and writes executed with memhub_batch, i.e. with a single memhub lock acquisition.
+ *  Register masks are applied as by readReg and writeReg. Operations are executed in the order they are queued
+ */
+struct regBatch {
+    /*! \struct entry
+     *  Queued register access
+     */
+    struct entry {
+        regInfo reg; /*!< Register descriptor */
+        std::string key; /*!< Response word the read value is reported to, empty if not reported */
+        bool write; /*!< True for a write, false for a read */
+        bool valid; /*!< False if the register was not found or is not accessible, the access is then skipped */
+        uint32_t value; /*!< Value to write before execution, masked value read after execution */
+    };
+    std::vector<entry> entries; /*!< Queued accesses */
+
+    /*! \fn size_t read(localArgs * la, const std::string & regName, const std::string & key = "")
+     *  \brief Queues a register read
+     *  \param la Local arguments structure
+     *  \param regName Register name
+     *  \param key Response word the value will be reported to by execute, not reported if empty
+     *  \return Index of the access, to be used with result
+     */
+    size_t read(localArgs * la, const std::string & regName, const std::string & key = "");
+
+    /*! \fn size_t read(const regInfo & reg, const std::string & key = "")
+     *  \brief Queues the read of a resolved register
+     */
+    size_t read(const regInfo & reg, const std::string & key = "");
+
+    /*! \fn size_t write(localArgs * la, const std::string & regName, uint32_t value)
+     *  \brief Queues a register write. Masked registers are read-modify-written within the batch
+     *  \param la Local arguments structure
+     *  \param regName Register name
+     *  \param value Value to write
+     */
+    size_t write(localArgs * la, const std::string & regName, uint32_t value);
+
+    /*! \fn size_t write(const regInfo & reg, uint32_t value)
+     *  \brief Queues the write of a resolved register
+     */
+    size_t write(const regInfo & reg, uint32_t value);
+
+    /*! \fn size_t writeRaw(localArgs * la, const std::string & regName, uint32_t value)
+     *  \brief Queues a register write. Register mask is not applied, as by writeRawReg
+     */
+    size_t writeRaw(localArgs * la, const std::string & regName, uint32_t value);
+
+    /*! \fn int execute(localArgs * la, uint32_t maxHoldUs = MEMHUB_DEFAULT_MAX_HOLD_US)
+     *  \brief Executes the queued accesses and reports read values to the response. Failed or skipped reads give 0xdeaddead
+     *  \param la Local arguments structure
+     *  \param maxHoldUs Maximum time the memhub lock is held before it is given to other processes, 0 for no limit
+     *  \return Number of failed or skipped accesses
+     */
+    int execute(localArgs * la, uint32_t maxHoldUs = MEMHUB_DEFAULT_MAX_HOLD_US);
+
+    /*! \fn uint32_t result(size_t i) const
+     *  \brief Returns the masked value read by access i after execute
+     */
+    uint32_t result(size_t i) const { return entries[i].value; }
+
+    /*! \fn void clear()
+     *  \brief Removes all the queued accesses
+     */
+    void clear() { entries.clear(); }
+};
+
+/*! \struct regWaitStats
+ *  Statistics of the waits done with a regWait
+ */
+struct regWaitStats {
+    uint32_t waits; /*!< Number of waits */
+    uint32_t timeouts; /*!< Number of waits which reached their deadline or failed to read the register */
+    uint64_t polls; /*!< Number of register reads */
+    uint64_t totalUs; /*!< Total time waited */
+    uint32_t maxUs; /*!< Longest wait */
+};
+
+/*! \struct regWait
+ *  Waits for a condition on a resolved register without address lookups in the loop. The register is polled with a sleep doubling
+ *  from minSleepUs up to maxSleepUs; the first sleep is half the mean duration of the previous waits, at most maxSleepUs, so that repeated waits of
+ *  similar length, e.g. one per scan point, do not poll during their expected duration
+ */
+struct regWait {
+    regInfo reg; /*!< Polled register */
+    uint32_t minSleepUs; /*!< Shortest sleep between two reads */
+    uint32_t maxSleepUs; /*!< Longest sleep between two reads */
+    regWaitStats stats; /*!< Statistics of the waits */
+
+    regWait() : reg(), minSleepUs(1), maxSleepUs(1000), stats() {}
+    regWait(const regInfo & reg, uint32_t minSleepUs = 1, uint32_t maxSleepUs = 1000) : reg(reg), minSleepUs(minSleepUs), maxSleepUs(maxSleepUs), stats() {}
+
+    /*! \fn bool until(Pred pred, uint32_t timeoutUs, uint32_t * value = NULL)
+     *  \brief Polls the register until pred(masked value) is true
+     *  \param pred Condition on the masked register value
+     *  \param timeoutUs Deadline of the wait, 0 for none
+     *  \param value Set to the last value read, 0xdeaddead if the read failed
+     *  \return false if the deadline was reached or the register could not be read
+     */
+    template<typename Pred>
+    bool until(Pred pred, uint32_t timeoutUs, uint32_t * value = NULL) {
+        auto start = std::chrono::steady_clock::now();
+        uint32_t sleepUs = stats.waits ? std::max<uint64_t>(minSleepUs, std::min<uint64_t>(maxSleepUs, stats.totalUs/stats.waits/2)) : minSleepUs;
+        uint32_t data;
+        bool done;
+        while (true) {
+            bool ok = poll(data);
+            done = ok && pred(data);
+            uint64_t elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-start).count();
+            if (done || !ok || (timeoutUs && elapsedUs >= timeoutUs)) {
+                record(elapsedUs, done);
+                break;
+            }
+            if (timeoutUs) sleepUs = std::min<uint64_t>(sleepUs, timeoutUs-elapsedUs);
+            std::this_thread::sleep_for(std::chrono::microseconds(sleepUs));
+            sleepUs = std::max(minSleepUs, std::min(2*sleepUs, maxSleepUs));
+        }
+        if (value) *value = data;
+        return done;
+    }
+
+    /*! \fn bool untilEqual(uint32_t expected, uint32_t timeoutUs)
+     *  \brief Polls the register until its masked value is expected
+     */
+    bool untilEqual(uint32_t expected, uint32_t timeoutUs) { return until([expected](uint32_t v) { return v == expected; }, timeoutUs); }
+
+    /*! \fn bool untilAtLeast(uint32_t expected, uint32_t timeoutUs)
+     *  \brief Polls the register until its masked value is at least expected
+     */
+    bool untilAtLeast(uint32_t expected, uint32_t timeoutUs) { return until([expected](uint32_t v) { return v >= expected; }, timeoutUs); }
+
+    /*! \fn void report(RPCMsg * response, const std::string & prefix) const
+     *  \brief Sets the statistics in the response as words prefix+"Waits", "Timeouts", "Polls", "TotalUs" and "MaxUs"
+     */
+    void report(RPCMsg * response, const std::string & prefix) const;
+
+    private:
+        /*! \brief Reads the masked register value, 0xdeaddead and false on failure */
+        bool poll(uint32_t & data);
+        /*! \brief Adds a wait to the statistics */
+        void record(uint64_t elapsedUs, bool done);
+};
+
+/*! \fn void setWordArray(const RPCMsg *request, RPCMsg *response, const std::string & key, const uint32_t *data, uint32_t count)
+ *  \brief Sets a word array in the response.
+ *         If the request has a non-zero "binaryPayload" word the words are attached as one binarydata blob instead,
+ *         avoiding the per-word encoding on the card and decoding on the host. The blob holds the words contiguously in the
+ *         card byte order (little endian), key+"_type" is set to "uint32le" to declare it
+ *  \param request RPC request message
+ *  \param response RPC response message
+ *  \param key Response key
+ *  \param data Words to send
+ *  \param count Number of words
+ */
+void setWordArray(const RPCMsg *request, RPCMsg *response, const std::string & key, const uint32_t *data, uint32_t count);
+
 /*! \fn uint32_t getNumNonzeroBits(uint32_t value)
  *  \brief returns the number of nonzero bits in an integer
  *  \param value integer to check the number of nonzero bits
  */
 uint32_t getNumNonzeroBits(uint32_t value);
 
+/*! \fn pid_t forkDetached(volatile pid_t *published = NULL)
+ *  \brief Forks a worker process detached from the RPC client: it is reparented to init, runs in its own session and does not hold the client sockets,
+ *          so it outlives the client connection. The worker must end with _exit
+ *  \param published If not NULL, e.g. a field in shared memory, the worker stores its pid there before returning, and the caller returns only after that
+ *  \return 0 in the worker, the worker pid in the caller, -1 on error
+ */
+pid_t forkDetached(volatile pid_t *published = NULL);
+
 /*! \fn uint32_t getMask(localArgs * la, const std::string & regName)
  *  \brief Returns the mask for a given register
  *  \param la Local arguments structure
@@ -131,6 +421,21 @@ uint32_t applyMask(uint32_t data, uint32_t mask);
  */
 uint32_t readReg(localArgs * la, const std::string & regName);
 
+/*! \fn uint32_t readReg(localArgs * la, const regInfo & reg)
+ *  \brief Reads a value from a resolved register. Register mask is applied. Will return 0xdeaddead if register is no accessible, a failed memsvc read also sets "error" in the response
+ *  \param la Local arguments structure
+ *  \param reg Register descriptor
+ */
+uint32_t readReg(localArgs * la, const regInfo & reg);
+
+/*! \fn void writeReg(localArgs * la, const regInfo & reg, uint32_t value)
+ *  \brief Writes a value to a resolved register. Register mask is applied
+ *  \param la Local arguments structure
+ *  \param reg Register descriptor
+ *  \param value Value to write
+ */
+void writeReg(localArgs * la, const regInfo & reg, uint32_t value);
+
 /*! \fn void writeReg(localArgs * la, const std::string & regName, uint32_t value)
  *  \brief Writes a value to a register. Register mask is applied
  *  \param la Local arguments structure
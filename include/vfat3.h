@@ -68,22 +68,33 @@ void configureVFAT3sLocal(localArgs * la, uint32_t ohN, uint32_t vfatMask);
  */
 void configureVFAT3s(const RPCMsg *request, RPCMsg *response);
 
-/*! \fn void getChannelRegistersVFAT3Local(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t *chanRegData)
+/*! \fn void getChannelRegistersVFAT3Local(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t *chanRegData, bool blockRead=false)
  *  \brief reads all channel registers for unmasked vfats and stores values in chanRegData
  *  \param la Local arguments structure
  *  \param ohN Optical link
  *  \param mask VFAT mask
  *  \param chanRegData pointer to the container holding channel registers; expected to be an array of 3072 channels with idx = vfatN * 128 + chan
+ *  \param blockRead read the 128 channel registers of a VFAT as one unpaced block when they are consecutive words, instead of one by one 200 us apart.
+ *                   Not yet validated on hardware
  */
-void getChannelRegistersVFAT3Local(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t *chanRegData);
+void getChannelRegistersVFAT3Local(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t *chanRegData, bool blockRead=false);
 
 /*! \fn void setChannelRegistersVFAT3(const RPCMsg *request, RPCMsg *response);
- *  \brief reads all vfat3 channel registers from host machine
+ *  \brief reads all vfat3 channel registers from host machine. The optional "blockRead" word selects the block read of getChannelRegistersVFAT3Local
  *  \param request RPC request message
  *  \param response RPC responce message
  */
 void getChannelRegistersVFAT3(const RPCMsg *request, RPCMsg *response);
 
+/*! \fn void getChannelRegistersVFAT3MultiLink(const RPCMsg *request, RPCMsg *response);
+ *  \brief As getChannelRegistersVFAT3(...) but for all optical links specified in ohMask on the AMC
+ *  \details The request should have a "ohMask" word, optionally a 12 word "ohVfatMaskArray" (by default the VFATs are masked with getOHVFATMaskLocal), "NOH" and "blockRead".
+ *           The response "chanRegDataAll" holds 12*3072 channel registers with idx = ohN * 3072 + vfatN * 128 + chan
+ *  \param request RPC request message
+ *  \param response RPC responce message
+ */
+void getChannelRegistersVFAT3MultiLink(const RPCMsg *request, RPCMsg *response);
+
 /*! \fn void readVFAT3ADCLocal(localArgs * la, uint32_t * outData, uint32_t ohN, bool useExtRefADC=false, uint32_t mask=0xFF000000)
  *  \brief reads the ADC of all unmasked VFATs
  *  \param la Local arguments structure
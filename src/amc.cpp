@@ -6,43 +6,82 @@
  */
 
 #include "amc.h"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <signal.h>
+#include <string.h>
 #include <string>
 #include <time.h>
 #include <thread>
 #include "utils.h"
 #include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-unsigned int fw_version_check(const char* caller_name, localArgs *la)
+static fwCapabilities fwCaps = {};
+
+const fwCapabilities & getFwCapabilities(localArgs *la)
 {
-    int iFWVersion = readReg(la, "GEM_AMC.GEM_SYSTEM.RELEASE.MAJOR");
-    char regBuf[200];
-    switch (iFWVersion){
+    uint32_t generation = getAddressTableGeneration();
+    if (fwCaps.generation != 0 && fwCaps.generation == generation) return fwCaps;
+
+    regBatch batch;
+    size_t iMajor = batch.read(la, "GEM_AMC.GEM_SYSTEM.RELEASE.MAJOR");
+    size_t iMinor = batch.read(la, "GEM_AMC.GEM_SYSTEM.RELEASE.MINOR");
+    size_t iBuild = batch.read(la, "GEM_AMC.GEM_SYSTEM.RELEASE.BUILD");
+    size_t iNumOfOH = batch.read(la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+    int nFailed = batch.execute(la);
+
+    fwCapabilities caps = {};
+    caps.major = batch.result(iMajor);
+    caps.minor = batch.result(iMinor);
+    caps.build = batch.result(iBuild);
+    caps.numOfOH = batch.result(iNumOfOH);
+    regInfo info;
+    caps.hasAdcCached = getRegInfo(la, "GEM_AMC.OH.OH0.GEB.VFAT0.ADC0_CACHED", info);
+    caps.hasVfatBroadcast = getRegInfo(la, "GEM_AMC.OH.OH0.GEB.VFAT_BROADCAST.CFG_RUN", info);
+    if (nFailed) return fwCaps = caps; //not cached, read again on the next call
+
+    caps.generation = generation;
+    fwCaps = caps;
+    switch (fwCaps.major){
         case 1:
-        {
-            LOGGER->log_message(LogManager::INFO, "System release major is 1, v2B electronics behavior");
+            LOGGER->log_message(LogManager::INFO, stdsprintf("System release %i.%i.%i, v2B electronics behavior", fwCaps.major, fwCaps.minor, fwCaps.build));
             break;
-        }
         case 3:
-        {
-            LOGGER->log_message(LogManager::INFO, "System release major is 3, v3 electronics behavior");
+            LOGGER->log_message(LogManager::INFO, stdsprintf("System release %i.%i.%i, v3 electronics behavior", fwCaps.major, fwCaps.minor, fwCaps.build));
             break;
-        }
-        default:
-        {
-            LOGGER->log_message(LogManager::ERROR, "Unexpected value for system release major!");
-            sprintf(regBuf,"Unexpected value for system release major!");
-            la->response->set_string("error",regBuf);
-            break;
-        }
+    }
+    return fwCaps;
+}
+
+unsigned int fw_version_check(const char* caller_name, localArgs *la)
+{
+    unsigned int iFWVersion = getFwCapabilities(la).major;
+    if (iFWVersion != 1 && iFWVersion != 3) {
+        LOGGER->log_message(LogManager::ERROR, stdsprintf("%s: Unexpected value for system release major!", caller_name));
+        la->response->set_string("error","Unexpected value for system release major!");
     }
     return iFWVersion;
 }
 
 uint32_t getOHVFATMaskLocal(localArgs * la, uint32_t ohN){
     uint32_t mask = 0x0;
+    regArray syncErrRegs;
+    if (!getRegArray(la, stdsprintf("GEM_AMC.OH_LINKS.OH%i.VFAT",ohN), 24, ".SYNC_ERR_CNT", syncErrRegs)){
+        return 0xffffff;
+    }
+    //Read the counters of all VFATs in one batch
+    regBatch batch;
+    for(int vfatN=0; vfatN<24; ++vfatN) batch.read(syncErrRegs.at(vfatN));
+    batch.execute(la);
     for(int vfatN=0; vfatN<24; ++vfatN){ //Loop over all vfats
-        uint32_t syncErrCnt = readReg(la, stdsprintf("GEM_AMC.OH_LINKS.OH%i.VFAT%i.SYNC_ERR_CNT",ohN,vfatN));
+        uint32_t syncErrCnt = batch.result(vfatN);
 
         if(syncErrCnt > 0x0){ //Case: nonzero sync errors, mask this vfat
             mask = mask + (0x1 << vfatN);
@@ -53,16 +92,10 @@ uint32_t getOHVFATMaskLocal(localArgs * la, uint32_t ohN){
 } //End getOHVFATMaskLocal()
 
 void getOHVFATMask(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     uint32_t vfatMask = getOHVFATMaskLocal(&la, ohN);
     LOGGER->log_message(LogManager::INFO, stdsprintf("Determined VFAT Mask for OH%i to be 0x%x",ohN,vfatMask));
 
@@ -72,21 +105,15 @@ void getOHVFATMask(const RPCMsg *request, RPCMsg *response){
 } //End getOHVFATMask(...)
 
 void getOHVFATMaskMultiLink(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     int ohMask = 0xfff;
     if(request->get_key_exists("ohMask")){
         ohMask = request->get_word("ohMask");
     }
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
-    unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
+    unsigned int NOH = getFwCapabilities(&la).numOfOH;
     if (request->get_key_exists("NOH")){
         unsigned int NOH_requested = request->get_word("NOH");
         if (NOH_requested <= NOH)
@@ -119,19 +146,60 @@ void getOHVFATMaskMultiLink(const RPCMsg *request, RPCMsg *response){
     return;
 } //End getOHVFATMaskMultiLink(...)
 
-std::vector<uint32_t> sbitReadOutLocal(localArgs *la, uint32_t ohN, uint32_t acquireTime, bool *maxNetworkSizeReached){
-    //Setup the sbit monitor
-    const int nclusters = 8;
+bool setupSbitMonitorLocal(localArgs *la, uint32_t ohN, sbitMonitorRegs & regs){
+    regInfo info;
     writeReg(la, "GEM_AMC.TRIGGER.SBIT_MONITOR.OH_SELECT", ohN);
-    uint32_t addrSbitMonReset=getAddress(la, "GEM_AMC.TRIGGER.SBIT_MONITOR.RESET");
-    uint32_t addrSbitL1ADelay=getAddress(la, "GEM_AMC.TRIGGER.SBIT_MONITOR.L1A_DELAY");
-    uint32_t addrSbitCluster[nclusters];
-    for(int iCluster=0; iCluster < nclusters; ++iCluster){
-        addrSbitCluster[iCluster] = getAddress(la, stdsprintf("GEM_AMC.TRIGGER.SBIT_MONITOR.CLUSTER%i",iCluster) );
+    if (!getRegInfo(la, "GEM_AMC.TRIGGER.SBIT_MONITOR.RESET", info)) return false;
+    regs.reset = info.address;
+    if (!getRegInfo(la, "GEM_AMC.TRIGGER.SBIT_MONITOR.L1A_DELAY", info)) return false;
+    regs.l1aDelay = info.address;
+    for(int iCluster=0; iCluster < 8; ++iCluster){
+        if (!getRegInfo(la, stdsprintf("GEM_AMC.TRIGGER.SBIT_MONITOR.CLUSTER%i",iCluster), info)) return false;
+        regs.cluster[iCluster] = info.address;
     }
 
     //Take the VFATs out of slow control only mode
     writeReg(la, "GEM_AMC.GEM_SYSTEM.VFAT3.SC_ONLY_MODE", 0x0);
+    return true;
+} //End setupSbitMonitorLocal(...)
+
+int readSbitMonitor(const sbitMonitorRegs & regs, uint32_t *clusters){
+    //Reset monitors
+    uint32_t one = 0x1;
+    if (memhub_write(memsvc, regs.reset, 1, &one) != 0) return -1;
+
+    //wait for 4095 clock cycles then read L1A delay and clusters
+    std::this_thread::sleep_for(std::chrono::nanoseconds(4095*25));
+    memhub_op ops[9];
+    ops[0] = {MEMHUB_READ, regs.l1aDelay, 0, 0, 0};
+    for(int cluster=0; cluster<8; ++cluster){
+        ops[cluster+1] = {MEMHUB_READ, regs.cluster[cluster], 0, 0, 0};
+    }
+    if (memhub_batch(memsvc, ops, 9, 0) != 0) return -1;
+
+    uint32_t l1ADelay = ops[0].value;
+    if(l1ADelay > 4095){ //Anything larger than this consider as overflow
+        l1ADelay = 4095; //(0xFFF in hex)
+    }
+    int nValid = 0;
+    for(int cluster=0; cluster<8; ++cluster){
+        uint32_t thisCluster = ops[cluster+1].value;
+        uint32_t sbitAddress = (thisCluster & 0x7ff);
+        int clusterSize = (thisCluster >> 12) & 0x7;
+        if(sbitAddress < 1536) ++nValid; //Possible values are [0,(24*64)-1]
+        clusters[cluster] = ((l1ADelay & 0x1fff) << 14) + ((clusterSize & 0x7) << 11) + (sbitAddress & 0x7ff);
+    }
+    return nValid;
+} //End readSbitMonitor(...)
+
+std::vector<uint32_t> sbitReadOutLocal(localArgs *la, uint32_t ohN, uint32_t acquireTime, bool *maxNetworkSizeReached){
+    //Setup the sbit monitor
+    const int nclusters = 8;
+    sbitMonitorRegs regs;
+    if (!setupSbitMonitorLocal(la, ohN, regs)) {
+        la->response->set_string("error", "SBIT Monitor registers not found");
+        return std::vector<uint32_t>();
+    }
 
     //[0:10] address of sbit cluster
     //[11:13] cluster size
@@ -143,46 +211,19 @@ std::vector<uint32_t> sbitReadOutLocal(localArgs *la, uint32_t ohN, uint32_t acq
     bool acquire=true;
     startTime=time(NULL);
     (*maxNetworkSizeReached) = false;
-    uint32_t l1ADelay;
+    uint32_t clusters[nclusters];
     while(acquire){
         if( sizeof(uint32_t) * storedSbits.size() > 65000 ){ //Max TCP/IP message is 65535
             (*maxNetworkSizeReached) = true;
             break;
         }
 
-        //Reset monitors
-        writeRawAddress(addrSbitMonReset, 0x1, la->response);
-
-        //wait for 4095 clock cycles then read L1A delay
-        std::this_thread::sleep_for(std::chrono::nanoseconds(4095*25));
-        l1ADelay = readRawAddress(addrSbitL1ADelay, la->response);
-        if(l1ADelay > 4095){ //Anything larger than this consider as overflow
-            l1ADelay = 4095; //(0xFFF in hex)
-        }
-
-        //get sbits
-        bool anyValid=false;
-        std::vector<uint32_t> tempSBits; //will only be stored into storedSbits if anyValid is true
-        for(int cluster=0; cluster<nclusters; ++cluster){
-            //bits [10:0] is the address of the cluster
-            //bits [14:12] is the cluster size
-            //bits 15 and 11 are not used
-            uint32_t thisCluster = readRawAddress(addrSbitCluster[cluster], la->response);
-            uint32_t sbitAddress = (thisCluster & 0x7ff);
-            int clusterSize = (thisCluster >> 12) & 0x7;
-            bool isValid = (sbitAddress < 1536); //Possible values are [0,(24*64)-1]
-
-            if(isValid){
-                LOGGER->log_message(LogManager::INFO,stdsprintf("valid sbit data: thisClstr %x; sbitAddr %x;",thisCluster,sbitAddress));
-                anyValid=true;
-            }
-
-            //Store the sbit
-            tempSBits.push_back( ((l1ADelay & 0x1fff) << 14) + ((clusterSize & 0x7) << 11) + (sbitAddress & 0x7ff) );
-        } //End Loop over clusters
-
-        if(anyValid){
-            storedSbits.insert(storedSbits.end(),tempSBits.begin(),tempSBits.end());
+        //will only be stored into storedSbits if any cluster is valid
+        int nValid = readSbitMonitor(regs, clusters);
+        if(nValid < 0){
+            LOGGER->log_message(LogManager::ERROR, "SBIT Monitor readout failed");
+        } else if(nValid > 0){
+            storedSbits.insert(storedSbits.end(), clusters, clusters + nclusters);
         }
 
         acquisitionTime=difftime(time(NULL),startTime);
@@ -195,19 +236,16 @@ std::vector<uint32_t> sbitReadOutLocal(localArgs *la, uint32_t ohN, uint32_t acq
 } //End sbitReadOutLocal(...)
 
 void sbitReadOut(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    sbitMonitorGuard sbitMonitor(response, "sbitReadOut");
+    if (!sbitMonitor.locked()) return;
+
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t acquireTime = request->get_word("acquireTime");
 
     bool maxNetworkSizeReached = false;
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
 
     time_t startTime=time(NULL);
     std::vector<uint32_t> storedSbits = sbitReadOutLocal(&la, ohN, acquireTime, &maxNetworkSizeReached);
@@ -222,6 +260,365 @@ void sbitReadOut(const RPCMsg *request, RPCMsg *response){
     return;
 } //End sbitReadOut()
 
+/*! \struct sbitStream
+ *  State of the streaming SBIT readout, shared between the acquisition thread and the RPC methods
+ */
+struct sbitStream {
+    std::mutex mutex; /*!< Protects ring and written */
+    std::vector<uint32_t> ring; /*!< Ring buffer of acquired words */
+    uint64_t written; /*!< Number of words written since the start, the ring holds the last ring.size() of them */
+    std::atomic<bool> running; /*!< True while the acquisition thread runs */
+    std::atomic<bool> stopRequested; /*!< Set by sbitReadOutStop */
+    std::atomic<uint32_t> readErrors; /*!< Failed SBIT Monitor readouts */
+    std::atomic<uint64_t> lostWords; /*!< Words overwritten in the ring before being fetched */
+    time_t startTime; /*!< Start of the acquisition */
+    time_t stopTime; /*!< End of the acquisition, valid once running is false */
+    std::thread worker; /*!< Acquisition thread */
+};
+
+#define SBIT_STREAM_MAX_BUFFER_SIZE (1 << 24) // 64 MB
+
+static sbitStream *sbitStreamState = NULL; //never deleted, a joinable thread must not be destroyed at exit
+
+static void sbitStreamAcquire(sbitMonitorRegs regs, uint32_t acquireTime){
+    sbitStream *st = sbitStreamState;
+    uint32_t clusters[8];
+    while(!st->stopRequested){
+        int nValid = readSbitMonitor(regs, clusters);
+        if (nValid < 0) {
+            ++st->readErrors;
+        } else if (nValid > 0) {
+            std::lock_guard<std::mutex> guard(st->mutex);
+            for(int cluster=0; cluster<8; ++cluster){
+                st->ring[(st->written + cluster) % st->ring.size()] = clusters[cluster];
+            }
+            st->written += 8;
+        }
+        if(acquireTime && difftime(time(NULL),st->startTime) > acquireTime){
+            break;
+        }
+    }
+    st->stopTime = time(NULL);
+    sbitMonitorReleaseLocal();
+    st->running = false;
+} //End sbitStreamAcquire(...)
+
+void sbitReadOutStart(const RPCMsg *request, RPCMsg *response){
+    addressTableTxn atxn;
+
+    uint32_t ohN = request->get_word("ohN");
+    uint32_t acquireTime = request->get_word("acquireTime");
+    uint32_t bufferSize = request->get_key_exists("bufferSize") ? request->get_word("bufferSize") : (1 << 20);
+    if (bufferSize > SBIT_STREAM_MAX_BUFFER_SIZE) {
+        response->set_string("error", stdsprintf("bufferSize %u is larger than the maximum of %u words", bufferSize, SBIT_STREAM_MAX_BUFFER_SIZE));
+        return;
+    }
+    bufferSize = std::max<uint32_t>(bufferSize - bufferSize%8, 8); //whole readouts only
+
+    if (sbitStreamState == NULL) sbitStreamState = new sbitStream();
+    sbitStream *st = sbitStreamState;
+    if (st->running) {
+        response->set_string("error", "A streaming SBIT readout is already running");
+        return;
+    }
+    if (st->worker.joinable()) st->worker.join();
+
+    //Claimed until the acquisition thread ends
+    if (!sbitMonitorAcquireLocal(response, "sbitReadOutStart")) return;
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
+    sbitMonitorRegs regs;
+    if (!setupSbitMonitorLocal(&la, ohN, regs)) {
+        sbitMonitorReleaseLocal();
+        response->set_string("error", "SBIT Monitor registers not found");
+        return;
+    }
+
+    st->ring.assign(bufferSize, 0);
+    st->written = 0;
+    st->readErrors = 0;
+    st->lostWords = 0;
+    st->stopRequested = false;
+    st->startTime = time(NULL);
+    st->running = true;
+    st->worker = std::thread(sbitStreamAcquire, regs, acquireTime);
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Started streaming SBIT readout of OH%i for %i s", ohN, acquireTime));
+} //End sbitReadOutStart()
+
+void sbitReadOutFetch(const RPCMsg *request, RPCMsg *response){
+    sbitStream *st = sbitStreamState;
+    if (st == NULL) {
+        response->set_string("error", "No streaming SBIT readout was started");
+        return;
+    }
+    uint32_t cursorWord = request->get_key_exists("cursor") ? request->get_word("cursor") : 0;
+    uint32_t maxWords = request->get_key_exists("maxWords") ? request->get_word("maxWords") : 16000;
+    bool running = st->running;
+
+    std::vector<uint32_t> storedSbits;
+    uint64_t lostWords = 0;
+    {
+        std::lock_guard<std::mutex> guard(st->mutex);
+        //the cursor travels as its low 32 bits, it is taken as the position at most 2^32-1 words before the last written one
+        uint32_t behind = (uint32_t)st->written - cursorWord;
+        uint64_t cursor = behind <= st->written ? st->written - behind : 0;
+        //words before the oldest one still in the ring were overwritten before this fetch
+        uint64_t oldest = st->written > st->ring.size() ? st->written - st->ring.size() : 0;
+        if (cursor < oldest) {
+            lostWords = oldest - cursor;
+            cursor = oldest;
+        }
+        if (cursor > st->written) cursor = st->written;
+        uint64_t n = std::min<uint64_t>(st->written - cursor, maxWords);
+        storedSbits.reserve(n);
+        for (uint64_t i = cursor; i < cursor + n; ++i) {
+            storedSbits.push_back(st->ring[i % st->ring.size()]);
+        }
+        cursor += n;
+        cursorWord = cursor;
+    }
+    st->lostWords += lostWords;
+
+    time_t approxLivetime = difftime(running ? time(NULL) : st->stopTime, st->startTime);
+    setWordArray(request, response, "storedSbits", storedSbits.data(), storedSbits.size());
+    response->set_word("cursor", cursorWord);
+    //the counters saturate at 2^32-1 rather than wrap
+    response->set_word("lostWords", std::min<uint64_t>(lostWords, 0xFFFFFFFF));
+    response->set_word("totalLostWords", std::min<uint64_t>(st->lostWords, 0xFFFFFFFF));
+    response->set_word("running", running);
+    response->set_word("approxLiveTime", approxLivetime);
+    response->set_word("readErrors", st->readErrors);
+} //End sbitReadOutFetch()
+
+void sbitReadOutStop(const RPCMsg * /*request*/, RPCMsg *response){
+    sbitStream *st = sbitStreamState;
+    if (st == NULL || !st->running) {
+        if (st != NULL && st->worker.joinable()) st->worker.join();
+        response->set_string("error", "No streaming SBIT readout is running in this connection");
+        return;
+    }
+    st->stopRequested = true;
+    if (st->worker.joinable()) st->worker.join();
+    LOGGER->log_message(LogManager::INFO, "Stopped streaming SBIT readout");
+} //End sbitReadOutStop()
+
+#define SBIT_MONITOR_SHM_NAME "/amc_sbit_monitor"
+#define SBIT_MONITOR_MAGIC 0x53424d32 // "SBM2"
+
+/*! \struct sbitMonitorShared
+ *  Histograms of the SBIT histogramming worker, shared by all the RPC processes of the card. Only the worker writes the histograms
+ */
+struct sbitMonitorShared {
+    uint32_t magic;
+    volatile pid_t worker; /*!< Worker process, 0 if none */
+    volatile uint32_t stopRequested; /*!< Set by sbitMonitorStop */
+    volatile uint32_t resetRequested; /*!< Set by sbitMonitorPoll, the worker clears the histograms */
+    uint32_t ohN;
+    uint32_t acquireTime;
+    time_t startTime;
+    volatile time_t stopTime;
+    volatile uint32_t readouts; /*!< SBIT Monitor readouts */
+    volatile uint32_t readErrors; /*!< Failed SBIT Monitor readouts */
+    volatile uint32_t vfatHits[24];
+    volatile uint32_t sbitHits[24*64];
+    volatile uint32_t clusterSizeHist[8];
+    volatile uint32_t l1aDelayHist[4096];
+    volatile pid_t owner; /*!< Process which claimed the SBIT Monitor with sbitMonitorAcquireLocal, 0 if none */
+    char ownerName[32]; /*!< User which claimed it */
+};
+
+static sbitMonitorShared *sbitMonitorState = NULL;
+
+static sbitMonitorShared *openSbitMonitorShared(RPCMsg *response){
+    if (sbitMonitorState != NULL) return sbitMonitorState;
+    int fd = shm_open(SBIT_MONITOR_SHM_NAME, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (st.st_size < (off_t)sizeof(sbitMonitorShared) && ftruncate(fd, sizeof(sbitMonitorShared)) != 0)) {
+        if (fd >= 0) close(fd);
+        response->set_string("error", stdsprintf("Unable to open the SBIT monitor shared memory: %s", strerror(errno)));
+        return NULL;
+    }
+    void *addr = mmap(NULL, sizeof(sbitMonitorShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        response->set_string("error", stdsprintf("Unable to map the SBIT monitor shared memory: %s", strerror(errno)));
+        return NULL;
+    }
+    sbitMonitorState = (sbitMonitorShared *)addr;
+    return sbitMonitorState;
+} //End openSbitMonitorShared(...)
+
+static bool sbitMonitorRunning(sbitMonitorShared *sh){
+    pid_t pid = sh->worker;
+    return pid != 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+} //End sbitMonitorRunning(...)
+
+static int sbitMonitorLockId(){
+    static int lockid = namedlock_init("amc", "sbitMonitor");
+    return lockid;
+} //End sbitMonitorLockId()
+
+bool sbitMonitorAcquireLocal(RPCMsg *response, const char *user){
+    sbitMonitorShared *sh = openSbitMonitorShared(response);
+    if (sh == NULL) return false;
+
+    int lockid = sbitMonitorLockId();
+    if (lockid < 0 || namedlock_lock(lockid) != 0) {
+        response->set_string("error", "Unable to lock the SBIT monitor");
+        return false;
+    }
+    //The histogramming worker uses the SBIT Monitor as long as it runs, the other users while they hold the claim
+    if (sbitMonitorRunning(sh)) {
+        namedlock_unlock(lockid);
+        response->set_string("error", stdsprintf("The SBIT monitor is running on OH%i", sh->ohN));
+        return false;
+    }
+    pid_t owner = sh->owner;
+    if (owner != 0 && (kill(owner, 0) == 0 || errno != ESRCH)) {
+        namedlock_unlock(lockid);
+        response->set_string("error", stdsprintf("The SBIT Monitor is used by %s in process %i", sh->ownerName, owner));
+        return false;
+    }
+    sh->owner = getpid();
+    snprintf(sh->ownerName, sizeof(sh->ownerName), "%s", user);
+    namedlock_unlock(lockid);
+    return true;
+} //End sbitMonitorAcquireLocal(...)
+
+void sbitMonitorReleaseLocal(){
+    sbitMonitorShared *sh = sbitMonitorState;
+    if (sh == NULL) return;
+    int lockid = sbitMonitorLockId();
+    bool locked = lockid >= 0 && namedlock_lock(lockid) == 0;
+    if (sh->owner == getpid()) sh->owner = 0;
+    if (locked) namedlock_unlock(lockid);
+} //End sbitMonitorReleaseLocal()
+
+static void clearSbitMonitorHistograms(sbitMonitorShared *sh){
+    sh->readouts = 0;
+    sh->readErrors = 0;
+    memset((void *)sh->vfatHits, 0, sizeof(sh->vfatHits));
+    memset((void *)sh->sbitHits, 0, sizeof(sh->sbitHits));
+    memset((void *)sh->clusterSizeHist, 0, sizeof(sh->clusterSizeHist));
+    memset((void *)sh->l1aDelayHist, 0, sizeof(sh->l1aDelayHist));
+} //End clearSbitMonitorHistograms(...)
+
+static void sbitMonitorWorker(sbitMonitorShared *sh, sbitMonitorRegs regs){
+    uint32_t clusters[8];
+    while(!sh->stopRequested){
+        if (sh->resetRequested) {
+            clearSbitMonitorHistograms(sh);
+            sh->resetRequested = 0;
+        }
+        int nValid = readSbitMonitor(regs, clusters);
+        ++sh->readouts;
+        if (nValid < 0) {
+            ++sh->readErrors;
+        } else if (nValid > 0) {
+            ++sh->l1aDelayHist[(clusters[0] >> 14) & 0xfff];
+            for(int cluster=0; cluster<8; ++cluster){
+                uint32_t sbitAddress = clusters[cluster] & 0x7ff;
+                if (sbitAddress >= 1536) continue;
+                int vfat = 7-int(sbitAddress/192)+int((sbitAddress%192)/64)*8;
+                ++sh->vfatHits[vfat];
+                ++sh->sbitHits[vfat*64 + sbitAddress%64];
+                ++sh->clusterSizeHist[(clusters[cluster] >> 11) & 0x7];
+            }
+        }
+        if(sh->acquireTime && difftime(time(NULL),sh->startTime) > sh->acquireTime){
+            break;
+        }
+    }
+    sh->stopTime = time(NULL);
+    sh->worker = 0;
+} //End sbitMonitorWorker(...)
+
+void sbitMonitorStart(const RPCMsg *request, RPCMsg *response){
+    addressTableTxn atxn;
+
+    uint32_t ohN = request->get_word("ohN");
+    uint32_t acquireTime = request->get_word("acquireTime");
+
+    sbitMonitorShared *sh = openSbitMonitorShared(response);
+    if (sh == NULL) return;
+
+    //The claim of this process is handed over to the worker: the SBIT Monitor is in use as long as the worker runs
+    if (!sbitMonitorAcquireLocal(response, "sbitMonitorStart")) return;
+
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
+    sbitMonitorRegs regs;
+    if (!setupSbitMonitorLocal(&la, ohN, regs)) {
+        sbitMonitorReleaseLocal();
+        response->set_string("error", "SBIT Monitor registers not found");
+        return;
+    }
+
+    sh->magic = SBIT_MONITOR_MAGIC;
+    clearSbitMonitorHistograms(sh);
+    sh->stopRequested = 0;
+    sh->resetRequested = 0;
+    sh->ohN = ohN;
+    sh->acquireTime = acquireTime;
+    sh->startTime = time(NULL);
+    sh->stopTime = sh->startTime;
+
+    //The worker outlives this client
+    pid_t worker = forkDetached(&sh->worker);
+    if (worker == 0) {
+        sbitMonitorWorker(sh, regs);
+        _exit(0);
+    }
+    sbitMonitorReleaseLocal();
+
+    if (worker < 0) {
+        response->set_string("error", stdsprintf("Unable to start the SBIT monitor worker: %s", strerror(errno)));
+        return;
+    }
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Started SBIT monitor of OH%i for %i s, worker %i", ohN, acquireTime, worker));
+} //End sbitMonitorStart()
+
+void sbitMonitorPoll(const RPCMsg *request, RPCMsg *response){
+    sbitMonitorShared *sh = openSbitMonitorShared(response);
+    if (sh == NULL) return;
+    if (sh->magic != SBIT_MONITOR_MAGIC) {
+        response->set_string("error", "The SBIT monitor was never started");
+        return;
+    }
+
+    bool running = sbitMonitorRunning(sh);
+    response->set_word("running", running);
+    response->set_word("ohN", sh->ohN);
+    response->set_word("approxLiveTime", difftime(running ? time(NULL) : sh->stopTime, sh->startTime));
+    response->set_word("readouts", sh->readouts);
+    response->set_word("readErrors", sh->readErrors);
+    response->set_word_array("vfatHits", (uint32_t *)sh->vfatHits, 24);
+    setWordArray(request, response, "sbitHits", (uint32_t *)sh->sbitHits, 24*64);
+    response->set_word_array("clusterSizeHist", (uint32_t *)sh->clusterSizeHist, 8);
+    setWordArray(request, response, "l1aDelayHist", (uint32_t *)sh->l1aDelayHist, 4096);
+
+    if (request->get_key_exists("reset") && request->get_word("reset")) {
+        if (running) {
+            sh->resetRequested = 1;
+        } else {
+            clearSbitMonitorHistograms(sh);
+        }
+    }
+} //End sbitMonitorPoll()
+
+void sbitMonitorStop(const RPCMsg * /*request*/, RPCMsg *response){
+    sbitMonitorShared *sh = openSbitMonitorShared(response);
+    if (sh == NULL) return;
+    sh->stopRequested = 1;
+    //A readout takes about 100 us, give the worker up to 1 s to exit
+    for (int i = 0; i < 1000 && sbitMonitorRunning(sh); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (sbitMonitorRunning(sh)) {
+        response->set_string("error", stdsprintf("The SBIT monitor worker %i did not stop", sh->worker));
+        return;
+    }
+    LOGGER->log_message(LogManager::INFO, "Stopped SBIT monitor");
+} //End sbitMonitorStop()
+
 extern "C" {
     const char *module_version_key = "amc v1.0.1";
     int module_activity_color = 4;
@@ -231,8 +628,15 @@ extern "C" {
             LOGGER->log_message(LogManager::ERROR, "Unable to load module");
             return; // Do not register our functions, we depend on memsvc.
         }
+        openAddressTable();
         modmgr->register_method("amc", "getOHVFATMask", getOHVFATMask);
         modmgr->register_method("amc", "getOHVFATMaskMultiLink", getOHVFATMaskMultiLink);
         modmgr->register_method("amc", "sbitReadOut", sbitReadOut);
+        modmgr->register_method("amc", "sbitReadOutStart", sbitReadOutStart);
+        modmgr->register_method("amc", "sbitReadOutFetch", sbitReadOutFetch);
+        modmgr->register_method("amc", "sbitReadOutStop", sbitReadOutStop);
+        modmgr->register_method("amc", "sbitMonitorStart", sbitMonitorStart);
+        modmgr->register_method("amc", "sbitMonitorPoll", sbitMonitorPoll);
+        modmgr->register_method("amc", "sbitMonitorStop", sbitMonitorStop);
     }
 }
@@ -1,30 +1,84 @@
 #include <algorithm>
 #include "amc.h"
 #include "calibration_routines.h"
+#include "hw_policy.h"
 #include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <map>
 #include <math.h>
 #include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "optohybrid.h"
 #include <thread>
 #include "vfat3.h"
+#include <unistd.h>
+
+static bool scanHardwareHeld = false; //true in a scan job worker, which holds the scan hardware lock while it runs the scan
+
+/*! \class scanHardwareGuard
+ *  Holds the "scanHardware" named lock in scope. Scans share the TTC generator and the VFAT_DAQ_MONITOR, so only one runs at a time:
+ *  scan job workers wait for the lock until their job is cancelled, the synchronous scan RPCs fail while it is taken.
+ *  Nested scans of a worker do not lock again
+ */
+class scanHardwareGuard {
+    public:
+        scanHardwareGuard(RPCMsg *response, bool wait) : lockid(-1), held(scanHardwareHeld) {
+            static int id = namedlock_init("calibration_routines", "scanHardware");
+            if (held) return;
+            if (id < 0) {
+                response->set_string("error", "Unable to lock the scan hardware");
+                return;
+            }
+            int ret = namedlock_trylock(id);
+            bool busy = ret != 0 && errno == EWOULDBLOCK;
+            //The lock is polled rather than waited for, so that a queued job can be cancelled
+            while (busy && wait && !scanJobCancelRequested()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                ret = namedlock_trylock(id);
+                busy = ret != 0 && errno == EWOULDBLOCK;
+            }
+            if (ret != 0) {
+                if (!busy) response->set_string("error", "Unable to lock the scan hardware");
+                else response->set_string("error", wait ? "The scan job was cancelled while waiting for the scan hardware" : "Another scan or a scan job is using the scan hardware");
+                return;
+            }
+            lockid = id;
+            held = scanHardwareHeld = true;
+        }
+        ~scanHardwareGuard() {
+            if (lockid < 0) return;
+            scanHardwareHeld = false;
+            namedlock_unlock(lockid);
+        }
+
+        /*! \brief True if the scan may use the hardware */
+        bool locked() const { return held; }
+
+    private:
+        int lockid;
+        bool held;
+};
 
 std::unordered_map<uint32_t, uint32_t> setSingleChanMask(int ohN, int vfatN, unsigned int ch, localArgs *la)
 {
-    char regBuf[200];
     std::unordered_map<uint32_t, uint32_t> map_chanOrigMask; //key -> reg addr; val -> reg value
-    uint32_t chanMaskAddr;
+    regArray chanMask;
+    if (!getChannelRegArray(la, ohN, vfatN, "MASK", chanMask)) return map_chanOrigMask;
     for(unsigned int chan=0; chan<128; ++chan){ //Loop Over All Channels
         uint32_t chMask = 1;
         if ( ch == chan){ //Do not mask the channel of interest
             chMask = 0;
         }
         //store the original channel mask
-        sprintf(regBuf, "GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.MASK",ohN,vfatN,chan);
-        chanMaskAddr=getAddress(la, regBuf);
-        map_chanOrigMask[chanMaskAddr]=readReg(la, regBuf);
+        regInfo chanMaskReg = chanMask.at(chan);
+        map_chanOrigMask[chanMaskReg.address]=readReg(la, chanMaskReg);
 
         //write the new channel mask
-        writeRawAddress(chanMaskAddr, chMask, la->response);
+        writeRawAddress(chanMaskReg.address, chMask, la->response);
     } //End Loop Over all Channels
     return map_chanOrigMask;
 }
@@ -40,42 +94,50 @@ bool confCalPulseLocal(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t ch,
     //Determine the inverse of the vfatmask
     uint32_t notmask = ~mask & 0xFFFFFF;
 
-    char regBuf[200];
     if(ch >= 128 && toggleOn == true){ //Case: Bad Config, asked for OR of all channels
         la->response->set_string("error","confCalPulseLocal(): I was told to calpulse all channels which doesn't make sense");
         return false;
     } //End Case: Bad Config, asked for OR of all channels
-    else if(ch == 128 && toggleOn == false){ //Case: Turn cal pusle off for all channels
+
+    //Resolve the registers of all VFATs once
+    regArray calMode, calFS, calDur, calPulseEnable;
+    if (!getVFATRegArray(la, ohN, "CFG_CAL_MODE", calMode)) return false;
+    if (toggleOn && currentPulse){
+        if (!getVFATRegArray(la, ohN, "CFG_CAL_FS", calFS)) return false;
+        if (!getVFATRegArray(la, ohN, "CFG_CAL_DUR", calDur)) return false;
+    }
+
+    if(ch == 128 && toggleOn == false){ //Case: Turn cal pusle off for all channels
         for(int vfatN = 0; vfatN < 24; vfatN++){ //Loop over all VFATs
             if((notmask >> vfatN) & 0x1){ //End VFAT is not masked
+                if (!getChannelRegArray(la, ohN, vfatN, "CALPULSE_ENABLE", calPulseEnable)) return false;
                 for(int chan=0; chan < 128; ++chan){ //Loop Over all Channels
-                    sprintf(regBuf,"GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.CALPULSE_ENABLE", ohN, vfatN, chan);
-                    writeReg(la, regBuf, 0x0);
+                    writeReg(la, calPulseEnable.at(chan), 0x0);
                 } //End Loop Over all Channels
-                writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_MODE", ohN, vfatN), 0x0);
+                writeReg(la, calMode.at(vfatN), 0x0);
             } //End VFAT is not masked
         } //End Loop over all VFATs
     } //End Case: Turn cal pulse off for all channels
     else{ //Case: Pulse a specific channel
+        if (!getVFATRegArray(la, ohN, stdsprintf("VFAT_CHANNELS.CHANNEL%i.CALPULSE_ENABLE", ch), calPulseEnable)) return false;
         for(int vfatN = 0; vfatN < 24; vfatN++){ //Loop over all VFATs
             if((notmask >> vfatN) & 0x1){ //End VFAT is not masked
-                sprintf(regBuf,"GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.CALPULSE_ENABLE", ohN, vfatN, ch);
                 if(toggleOn == true){ //Case: turn calpulse on
-                    writeReg(la, regBuf, 0x1);
+                    writeReg(la, calPulseEnable.at(vfatN), 0x1);
                     if(currentPulse){ //Case: cal mode current injection
-                        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_MODE", ohN, vfatN), 0x2);
+                        writeReg(la, calMode.at(vfatN), 0x2);
 
                         //Set cal current pulse scale factor. Q = CAL DUR[s] * CAL DAC * 10nA * CAL FS[%] (00 = 25%, 01 = 50%, 10 = 75%, 11 = 100%)
-                        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_FS", ohN, vfatN), calScaleFactor);
-                        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_DUR", ohN, vfatN), 0x0);
+                        writeReg(la, calFS.at(vfatN), calScaleFactor);
+                        writeReg(la, calDur.at(vfatN), 0x0);
                     } //End Case: cal mode current injection
                     else { //Case: cal mode voltage injection
-                        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_MODE", ohN, vfatN), 0x1);
+                        writeReg(la, calMode.at(vfatN), 0x1);
                     } //Case: cal mode voltage injection
                 } //End Case: Turn calpulse on
                 else{ //Case: Turn calpulse off
-                    writeReg(la, regBuf, 0x0);
-                    writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_CAL_MODE", ohN, vfatN), 0x0);
+                    writeReg(la, calPulseEnable.at(vfatN), 0x0);
+                    writeReg(la, calMode.at(vfatN), 0x0);
                 } //End Case: Turn calpulse off
             } //End VFAT is not masked
         } //End Loop over all VFATs
@@ -160,18 +222,12 @@ void ttcGenToggleLocal(localArgs * la, uint32_t ohN, bool enable)
 
 void ttcGenToggle(const RPCMsg *request, RPCMsg *response)
 {
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
     bool enable = request->get_word("enable");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     ttcGenToggleLocal(&la, ohN, enable);
 
     return;
@@ -256,13 +312,7 @@ void ttcGenConfLocal(localArgs * la, uint32_t ohN, uint32_t mode, uint32_t type,
 void ttcGenConf(const RPCMsg *request, RPCMsg *response)
 {
     LOGGER->log_message(LogManager::INFO, "Entering ttcGenConf");
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t mode = request->get_word("mode");
@@ -272,132 +322,245 @@ void ttcGenConf(const RPCMsg *request, RPCMsg *response)
     uint32_t nPulses = request->get_word("nPulses");
     bool enable = request->get_word("enable");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     LOGGER->log_message(LogManager::INFO, stdsprintf("Calling ttcGenConfLocal with ohN : %i, mode : %i, type : %i, pulse delay : %i, L1A interval : %i, number of pulses : %i", ohN,mode,type,pulseDelay,L1Ainterval,nPulses));
     ttcGenConfLocal(&la, ohN, mode, type, pulseDelay, L1Ainterval, nPulses, enable);
 
     return;
 }
 
-void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useUltra, bool useExtTrig)
+/*! \struct genScanLink
+ *  Optohybrid scanned by genScanV3Local. The results of the links of a scan are laid out in one buffer, in link order
+ */
+struct genScanLink {
+    uint32_t ohN;
+    uint32_t mask; /*!< VFAT mask */
+    uint32_t *outData; /*!< Results of the link, in the layout of genScanLocal */
+    regArray scanRegs; /*!< Scan register of the 24 VFATs */
+};
+
+/*! \struct genScanRegs
+ *  TTC and VFAT_DAQ_MONITOR registers used by genScanV3Local, resolved once per scan
+ */
+struct genScanRegs {
+    regArray daqMonEvts, daqMonFires;
+    regInfo monEnable, monReset, monOhSelect, monChannelSelect, monGlobalOr;
+    regInfo l1aCount, cntReset, l1aEnable, cyclicL1aCount, singleResync, cyclicStart, genEnable, cyclicRunning, cyclicL1aGap;
+    uint32_t l1aGap; /*!< TTC generator L1A gap, in bunch crossings */
+    regWait l1aWait; /*!< Wait for the external L1As */
+    regWait cyclicWait; /*!< Wait for the end of the TTC generator cycle */
+};
+
+#define GENSCAN_EXT_TRIG_TIMEOUT_US 300000000 // 5 min for the external L1As of one DAC value
+
+/*! \brief Checks the parameters and the VFAT synchronization of all links and resolves the registers of the scan.
+ *         Returns false with an error in the response on failure */
+static bool genScanV3Setup(localArgs *la, std::vector<genScanLink> & links, genScanRegs & regs, const std::string & scanReg, bool currentPulse, uint32_t calScaleFactor)
 {
-    //Determine the inverse of the vfatmask
-    uint32_t notmask = ~mask & 0xFFFFFF;
-
-    //Check firmware version
-    switch(fw_version_check("genScanLocal", la)) {
-        case 3: //v3 electronics behavior
-        {
-            uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
-            char regBuf[200];
-            if( (notmask & goodVFATs) != notmask)
-            {
-                sprintf(regBuf,"One of the unmasked VFATs is not Synced. goodVFATs: %x\tnotmask: %x",goodVFATs,notmask);
-                la->response->set_string("error",regBuf);
-                return;
-            }
+    if (currentPulse && calScaleFactor > 3){
+        la->response->set_string("error",stdsprintf("Bad value for CFG_CAL_FS: %x, Possible values are {0b00, 0b01, 0b10, 0b11}. Exiting.",calScaleFactor));
+        return false;
+    }
 
-            if (currentPulse && calScaleFactor > 3){
-                sprintf(regBuf,"Bad value for CFG_CAL_FS: %x, Possible values are {0b00, 0b01, 0b10, 0b11}. Exiting.",calScaleFactor);
-                la->response->set_string("error",regBuf);
-                return;
-            }
+    for (auto & link : links) {
+        uint32_t notmask = ~link.mask & 0xFFFFFF;
+        uint32_t goodVFATs = vfatSyncCheckLocal(la, link.ohN);
+        if( (notmask & goodVFATs) != notmask){
+            la->response->set_string("error",stdsprintf("One of the unmasked VFATs of OH%i is not Synced. goodVFATs: %x\tnotmask: %x",link.ohN,goodVFATs,notmask));
+            return false;
+        }
+        if (!getVFATRegArray(la, link.ohN, "CFG_"+scanReg, link.scanRegs)) return false;
+    }
 
-            //Do we turn on the calpulse for the channel = ch?
-            if(useCalPulse){
-                if (confCalPulseLocal(la, ohN, mask, ch, true, currentPulse, calScaleFactor) == false){
-                    la->response->set_string("error",stdsprintf("Unable to configure calpulse ON for ohN %i mask %x chan %i", ohN, mask, ch));
-                    return; //Calibration pulse is not configured correctly
-                }
-            } //End use calibration pulse
+    if (!getRegArray(la, "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.VFAT", 24, ".GOOD_EVENTS_COUNT", regs.daqMonEvts)
+            || !getRegArray(la, "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.VFAT", 24, ".CHANNEL_FIRE_COUNT", regs.daqMonFires)){
+        return false;
+    }
+    std::pair<const char *, regInfo *> named[] = {
+        {"GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.ENABLE", &regs.monEnable},
+        {"GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.RESET", &regs.monReset},
+        {"GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.OH_SELECT", &regs.monOhSelect},
+        {"GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.VFAT_CHANNEL_SELECT", &regs.monChannelSelect},
+        {"GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.VFAT_CHANNEL_GLOBAL_OR", &regs.monGlobalOr},
+        {"GEM_AMC.TTC.CMD_COUNTERS.L1A", &regs.l1aCount},
+        {"GEM_AMC.TTC.CTRL.CNT_RESET", &regs.cntReset},
+        {"GEM_AMC.TTC.CTRL.L1A_ENABLE", &regs.l1aEnable},
+        {"GEM_AMC.TTC.GENERATOR.CYCLIC_L1A_COUNT", &regs.cyclicL1aCount},
+        {"GEM_AMC.TTC.GENERATOR.CYCLIC_L1A_GAP", &regs.cyclicL1aGap},
+        {"GEM_AMC.TTC.GENERATOR.SINGLE_RESYNC", &regs.singleResync},
+        {"GEM_AMC.TTC.GENERATOR.CYCLIC_START", &regs.cyclicStart},
+        {"GEM_AMC.TTC.GENERATOR.ENABLE", &regs.genEnable},
+        {"GEM_AMC.TTC.GENERATOR.CYCLIC_RUNNING", &regs.cyclicRunning}
+    };
+    for (auto & reg : named) {
+        if (!getRegInfo(la, reg.first, *reg.second)) {
+            la->response->set_string("error", stdsprintf("Register %s not found", reg.first));
+            return false;
+        }
+    }
+    regs.l1aGap = readReg(la, regs.cyclicL1aGap);
+    regs.l1aWait = regWait(regs.l1aCount, 10, 200);
+    regs.cyclicWait = regWait(regs.cyclicRunning, 5, 50);
+    return true;
+}
 
-            //Get addresses
-            uint32_t daqMonAddr[24];
-            uint32_t l1CntAddr = getAddress(la, "GEM_AMC.TTC.CMD_COUNTERS.L1A");
-            for(int vfatN = 0; vfatN < 24; vfatN++)
-            {
-                sprintf(regBuf,"GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.VFAT%i.GOOD_EVENTS_COUNT",vfatN);
-                daqMonAddr[vfatN] = getAddress(la, regBuf);
+/*! \brief Scans channel ch of all links with the registers resolved by genScanV3Setup.
+ *         The scan register is written on all links at once for each DAC value, then the links are triggered
+ *         in turn as the VFAT_DAQ_MONITOR only follows one optohybrid at a time.
+ *         In a scan job the resultWords words of the final result at results, which holds the outData of the links, are published after each DAC value */
+static void genScanV3Local(localArgs *la, const std::vector<genScanLink> & links, genScanRegs & regs, const uint32_t *results, uint32_t resultWords, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, bool useExtTrig)
+{
+    //An error stops the scan, which still turns the calpulse off
+    bool failed = false;
+
+    //Do we turn on the calpulse for the channel = ch?
+    if(useCalPulse){
+        for (auto & link : links) {
+            if (confCalPulseLocal(la, link.ohN, link.mask, ch, true, currentPulse, calScaleFactor) == false){
+                la->response->set_string("error",stdsprintf("Unable to configure calpulse ON for ohN %i mask %x chan %i", link.ohN, link.mask, ch));
+                failed = true; //Calibration pulse is not configured correctly
+                break;
             }
+        }
+    } //End use calibration pulse
 
-            //TTC Config
-            if(useExtTrig){
-                writeReg(la, "GEM_AMC.TTC.CTRL.L1A_ENABLE", 0x0);
-                writeReg(la, "GEM_AMC.TTC.CTRL.CNT_RESET", 0x1);
-            }
-            else{
-                writeReg(la, "GEM_AMC.TTC.GENERATOR.CYCLIC_L1A_COUNT", nevts);
-                writeReg(la, "GEM_AMC.TTC.GENERATOR.SINGLE_RESYNC", 0x1);
-            }
+    //TTC Config
+    if(useExtTrig){
+        writeReg(la, regs.l1aEnable, 0x0);
+        writeReg(la, regs.cntReset, 0x1);
+    }
+    else{
+        writeReg(la, regs.cyclicL1aCount, nevts);
+        writeReg(la, regs.singleResync, 0x1);
+    }
 
-            //Configure VFAT_DAQ_MONITOR
-            dacMonConfLocal(la, ohN, ch);
+    //Configure VFAT_DAQ_MONITOR, the optohybrid is selected for each trigger cycle
+    regBatch monConf;
+    monConf.write(regs.monEnable, 0x0);
+    monConf.write(regs.monReset, 0x1);
+    if(ch>127){
+        monConf.write(regs.monGlobalOr, 0x1);
+    }
+    else{
+        monConf.write(regs.monChannelSelect, ch);
+        monConf.write(regs.monGlobalOr, 0x0);
+    }
+    monConf.execute(la);
+    bool useGenerator = !useExtTrig && readReg(la, regs.genEnable);
 
-            //Scan over DAC values
-            for(uint32_t dacVal = dacMin; dacVal <= dacMax; dacVal += dacStep)
-            {
-                //Write the scan reg value
-                for(int vfatN = 0; vfatN < 24; vfatN++) if((notmask >> vfatN) & 0x1)
-                {
-                    writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_%s",ohN,vfatN,scanReg.c_str()), dacVal);
-                }
+    //The generator cycle lasts nevts L1A gaps of 25 ns, allow twice that plus a second
+    uint32_t cyclicTimeoutUs = std::min<uint64_t>(2*(uint64_t)nevts*regs.l1aGap*25/1000+1000000, 0xFFFFFFFF);
 
-                //Reset and enable the VFAT_DAQ_MONITOR
-                writeReg(la, "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.RESET", 0x1);
-                writeReg(la, "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.ENABLE", 0x1);
+    //Scan over DAC values
+    scanJobLoop progress((dacMax-dacMin)/dacStep+1);
+    for(uint32_t dacVal = dacMin; dacVal <= dacMax && !failed; dacVal += dacStep)
+    {
+        //Write the scan reg value of all links
+        regBatch scanWrites;
+        for (auto & link : links) {
+            for(int vfatN = 0; vfatN < 24; vfatN++) if(!((link.mask >> vfatN) & 0x1)) scanWrites.write(link.scanRegs.at(vfatN), dacVal);
+        }
+        if (scanWrites.execute(la)) {
+            la->response->set_string("error", stdsprintf("Unable to write CFG scan register to %i", dacVal));
+            failed = true;
+            break;
+        }
 
-                //Start the triggers
-                if(useExtTrig){
-                    writeReg(la, "GEM_AMC.TTC.CTRL.CNT_RESET", 0x1);
-                    writeReg(la, "GEM_AMC.TTC.CTRL.L1A_ENABLE", 0x1);
+        for (auto & link : links) {
+            //Select, reset and enable the VFAT_DAQ_MONITOR
+            writeReg(la, regs.monOhSelect, link.ohN);
+            writeReg(la, regs.monReset, 0x1);
+            writeReg(la, regs.monEnable, 0x1);
 
-                    uint32_t l1aCnt = 0;
-                    while(l1aCnt < nevts){
-                        l1aCnt = readRawAddress(l1CntAddr, la->response);
-                        std::this_thread::sleep_for(std::chrono::microseconds(200));
+            //Start the triggers
+            if(useExtTrig){
+                writeReg(la, regs.cntReset, 0x1);
+                writeReg(la, regs.l1aEnable, 0x1);
+
+                //External triggers have no known rate: the wait has a generous deadline, and a scan job stops waiting when it is cancelled
+                uint32_t l1aCount = 0;
+                bool done = regs.l1aWait.until([nevts](uint32_t v) { return v >= nevts || scanJobCancelRequested(); }, GENSCAN_EXT_TRIG_TIMEOUT_US, &l1aCount);
+                writeReg(la, regs.l1aEnable, 0x0);
+                if (!done){
+                    writeReg(la, regs.monEnable, 0x0);
+                    if (l1aCount == 0xdeaddead) {
+                        la->response->set_string("error", stdsprintf("Unable to read the L1A counter while scanning OH%i", link.ohN));
+                    } else {
+                        la->response->set_string("error", stdsprintf("Only %i of %i external L1As were received within %i s while scanning OH%i", l1aCount, nevts, GENSCAN_EXT_TRIG_TIMEOUT_US/1000000, link.ohN));
                     }
-
-                    writeReg(la, "GEM_AMC.TTC.CTRL.L1A_ENABLE", 0x0);
-                    l1aCnt = readRawAddress(l1CntAddr, la->response);
+                    failed = true;
+                    break;
                 }
-                else{
-                    writeReg(la, "GEM_AMC.TTC.GENERATOR.CYCLIC_START", 0x1);
-                    if(readReg(la, "GEM_AMC.TTC.GENERATOR.ENABLE")){ //TTC Commands from TTC.GENERATOR
-                        while(readReg(la, "GEM_AMC.TTC.GENERATOR.CYCLIC_RUNNING")){
-                            std::this_thread::sleep_for(std::chrono::microseconds(50));
-                        }
-                    } //End TTC Commands from TTC.GENERATOR
+                if (l1aCount < nevts){ //cancelled, the next loop step stops the scan
+                    writeReg(la, regs.monEnable, 0x0);
+                    break;
                 }
+            }
+            else{
+                writeReg(la, regs.cyclicStart, 0x1);
+                if(useGenerator && !regs.cyclicWait.untilEqual(0x0, cyclicTimeoutUs)){ //TTC Commands from TTC.GENERATOR
+                    writeReg(la, regs.monEnable, 0x0);
+                    la->response->set_string("error", stdsprintf("TTC generator cycle of %i L1As did not end within %i us while scanning OH%i", nevts, cyclicTimeoutUs, link.ohN));
+                    failed = true;
+                    break;
+                } //End TTC Commands from TTC.GENERATOR
+            }
 
-                //Stop the DAQ monitor counters from incrementing
-                writeReg(la, "GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.CTRL.ENABLE", 0x0);
+            //Stop the DAQ monitor counters from incrementing
+            writeReg(la, regs.monEnable, 0x0);
 
-                //Read the DAQ Monitor counters
-                for(int vfatN = 0; vfatN < 24; vfatN++){
-                    if ( !( (notmask >> vfatN) & 0x1)) continue;
+            //Read the DAQ Monitor counters of all VFATs at once
+            regBatch counters;
+            for(int vfatN = 0; vfatN < 24; vfatN++){
+                counters.read(regs.daqMonEvts.at(vfatN));
+                counters.read(regs.daqMonFires.at(vfatN));
+            }
+            counters.execute(la);
+            for(int vfatN = 0; vfatN < 24; vfatN++){
+                if ( (link.mask >> vfatN) & 0x1) continue;
 
-                    int idx = vfatN*(dacMax-dacMin+1)/dacStep+(dacVal-dacMin)/dacStep;
-                    outData[idx] = readRawAddress(daqMonAddr[vfatN], la->response);
+                int idx = vfatN*(dacMax-dacMin+1)/dacStep+(dacVal-dacMin)/dacStep;
+                link.outData[idx] = counters.result(2*vfatN);
+                LOGGER->log_message(LogManager::DEBUG, stdsprintf("OH%i VFAT%i: Value: %i; Nhits: %i; Nev: %i",
+                            link.ohN, vfatN, dacVal, counters.result(2*vfatN+1), counters.result(2*vfatN)));
+            } //End Loop over vfats
+        } //End Loop over links
+        if (failed) break;
+
+        bool more = progress.step((dacVal-dacMin)/dacStep+1, dacVal, ch);
+        if (progress.outermost()) scanJobPartial(results, resultWords);
+        if (!more) break;
+    } //End Loop from dacMin to dacMax
+
+    regs.l1aWait.report(la->response, "l1aWait");
+    regs.cyclicWait.report(la->response, "cyclicWait");
+
+    //If the calpulse for channel ch was turned on, turn it off
+    if(useCalPulse){
+        for (auto & link : links) {
+            if (confCalPulseLocal(la, link.ohN, link.mask, ch, false, currentPulse, calScaleFactor) == false){
+                //an earlier error is kept, it is the cause of the scan failure
+                if (!failed) la->response->set_string("error",stdsprintf("Unable to configure calpulse OFF for ohN %i mask %x chan %i", link.ohN, link.mask, ch));
+                LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to configure calpulse OFF for ohN %i mask %x chan %i", link.ohN, link.mask, ch));
+            }
+        }
+    }
+}
 
-                    LOGGER->log_message(LogManager::DEBUG, stdsprintf("%s Value: %i; Readback Val: %i; Nhits: %i; Nev: %i; CFG_THR_ARM: %i",
-                                 scanReg.c_str(),
-                                 dacVal,
-                                 readReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_%s",ohN,vfatN,scanReg.c_str())),
-                                 readReg(la, stdsprintf("GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.VFAT%i.CHANNEL_FIRE_COUNT",vfatN)),
-                                 readReg(la, stdsprintf("GEM_AMC.GEM_TESTS.VFAT_DAQ_MONITOR.VFAT%i.GOOD_EVENTS_COUNT",vfatN)),
-                                 readReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_THR_ARM_DAC",ohN,vfatN,scanReg.c_str()))
-                        )
-                    );
-                } //End Loop over vfats
-            } //End Loop from dacMin to dacMax
+void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useUltra, bool useExtTrig)
+{
+    //Determine the inverse of the vfatmask
+    uint32_t notmask = ~mask & 0xFFFFFF;
 
-            //If the calpulse for channel ch was turned on, turn it off
-            if(useCalPulse){
-                if (confCalPulseLocal(la, ohN, mask, ch, false, currentPulse, calScaleFactor) == false){
-                    la->response->set_string("error",stdsprintf("Unable to configure calpulse OFF for ohN %i mask %x chan %i", ohN, mask, ch));
-                    return; //Calibration pulse is not configured correctly
-                }
-            }
+    //Check firmware version
+    switch(fw_version_check("genScanLocal", la)) {
+        case 3: //v3 electronics behavior
+        {
+            genScanLink link = {ohN, mask, outData, regArray()};
+            std::vector<genScanLink> links(1, link);
+            genScanRegs regs;
+            if (!genScanV3Setup(la, links, regs, scanReg, currentPulse, calScaleFactor)) return;
+            genScanV3Local(la, links, regs, outData, 24*(dacMax-dacMin+1)/dacStep, ch, useCalPulse, currentPulse, calScaleFactor, nevts, dacMin, dacMax, dacStep, useExtTrig);
             break;
         }//End v3 electronics behavior
         case 1: //v2b electronics behavior
@@ -457,8 +620,8 @@ void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask,
                 else{
                     for(int vfat=0; vfat<24; ++vfat){
                         if ( (notmask >> vfat) & 0x1){
-                            trimVal = (0x3f & readReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFATS.VFAT%i.VFATChannels.ChanReg%i",ohN,vfat,ch)));
-                            writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFATS.VFAT%i.VFATChannels.ChanReg%i",ohN,vfat,ch),trimVal+64);
+                            trimVal = (0x3f & readReg(la, channelRegName<V2bPolicy>(ohN,vfat,ch)));
+                            writeReg(la, channelRegName<V2bPolicy>(ohN,vfat,ch),trimVal+64);
                         }
                     }
                 }
@@ -471,8 +634,8 @@ void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask,
             if(useCalPulse){
                 for(int vfat=0; vfat<24; ++vfat){
                     if ( (notmask >> vfat) & 0x1){
-                        trimVal = (0x3f & readReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFATS.VFAT%i.VFATChannels.ChanReg%i",ohN,vfat,ch)));
-                        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFATS.VFAT%i.VFATChannels.ChanReg%i",ohN,vfat,ch),trimVal);
+                        trimVal = (0x3f & readReg(la, channelRegName<V2bPolicy>(ohN,vfat,ch)));
+                        writeReg(la, channelRegName<V2bPolicy>(ohN,vfat,ch),trimVal);
                     }
                 }
             }
@@ -492,13 +655,10 @@ void genScanLocal(localArgs *la, uint32_t *outData, uint32_t ohN, uint32_t mask,
 
 void genScan(const RPCMsg *request, RPCMsg *response)
 {
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    scanHardwareGuard hardware(response, false);
+    if (!hardware.locked()) return;
+
+    addressTableTxn atxn;
 
     uint32_t nevts = request->get_word("nevts");
     uint32_t ohN = request->get_word("ohN");
@@ -518,7 +678,7 @@ void genScan(const RPCMsg *request, RPCMsg *response)
     }
     bool useExtTrig = request->get_word("useExtTrig");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     uint32_t outData[24*(dacMax-dacMin+1)/dacStep];
     genScanLocal(&la, outData, ohN, mask, ch, useCalPulse, currentPulse, calScaleFactor, nevts, dacMin, dacMax, dacStep, scanReg, useUltra, useExtTrig);
     response->set_word_array("data",outData,24*(dacMax-dacMin+1)/dacStep);
@@ -526,6 +686,80 @@ void genScan(const RPCMsg *request, RPCMsg *response)
     return;
 }
 
+void genScanMultiLinkLocal(localArgs *la, uint32_t *outData, uint32_t ohMask, const uint32_t *ohVfatMasks, uint32_t NOH, uint32_t ch, bool useCalPulse, bool currentPulse, uint32_t calScaleFactor, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, bool useExtTrig)
+{
+    if (fw_version_check("genScanMultiLink", la) != 3){
+        la->response->set_string("error", "genScanMultiLink is only supported in V3 electronics");
+        return;
+    }
+
+    std::vector<genScanLink> links;
+    for(unsigned int ohN=0; ohN<NOH && ohN<12; ++ohN){
+        // If this Optohybrid is masked skip it
+        if(!((ohMask >> ohN) & 0x1)) continue;
+        genScanLink link = {ohN, ohVfatMasks[ohN], outData+ohN*24*(dacMax-dacMin+1)/dacStep, regArray()};
+        links.push_back(link);
+    }
+    if (links.empty()) return;
+
+    genScanRegs regs;
+    if (!genScanV3Setup(la, links, regs, scanReg, currentPulse, calScaleFactor)) return;
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Performing %s scan of channel %i for OH Mask 0x%x", scanReg.c_str(), ch, ohMask));
+    genScanV3Local(la, links, regs, outData, NOH*24*(dacMax-dacMin+1)/dacStep, ch, useCalPulse, currentPulse, calScaleFactor, nevts, dacMin, dacMax, dacStep, useExtTrig);
+} //End genScanMultiLinkLocal(...)
+
+void genScanMultiLink(const RPCMsg *request, RPCMsg *response)
+{
+    scanHardwareGuard hardware(response, false);
+    if (!hardware.locked()) return;
+
+    addressTableTxn atxn;
+
+    uint32_t ohMask = request->get_word("ohMask");
+    uint32_t nevts = request->get_word("nevts");
+    uint32_t ch = request->get_word("ch");
+    uint32_t dacMin = request->get_word("dacMin");
+    uint32_t dacMax = request->get_word("dacMax");
+    uint32_t dacStep = request->get_word("dacStep");
+    bool useCalPulse = request->get_word("useCalPulse");
+    bool currentPulse = request->get_word("currentPulse");
+    uint32_t calScaleFactor = request->get_word("calScaleFactor");
+    std::string scanReg = request->get_string("scanReg");
+    bool useExtTrig = request->get_word("useExtTrig");
+
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
+
+    unsigned int NOH = getFwCapabilities(&la).numOfOH;
+    if (request->get_key_exists("NOH")){
+        unsigned int NOH_requested = request->get_word("NOH");
+        if (NOH_requested <= NOH)
+            NOH = NOH_requested;
+        else
+            LOGGER->log_message(LogManager::WARNING, stdsprintf("NOH requested (%i) > NUM_OF_OH AMC register value (%i), NOH request will be disregarded",NOH_requested,NOH));
+    }
+    NOH = std::min(NOH, 12u);
+
+    uint32_t ohVfatMaskArray[12];
+    if (request->get_key_exists("ohVfatMaskArray")) {
+        if (request->get_word_array_size("ohVfatMaskArray") != 12) {
+            response->set_string("error", "ohVfatMaskArray must have 12 words");
+            return;
+        }
+        request->get_word_array("ohVfatMaskArray", ohVfatMaskArray);
+    }
+    else {
+        for(unsigned int ohN=0; ohN<NOH; ++ohN){
+            if((ohMask >> ohN) & 0x1) ohVfatMaskArray[ohN] = getOHVFATMaskLocal(&la, ohN);
+        }
+    }
+
+    std::vector<uint32_t> outData(NOH*24*(dacMax-dacMin+1)/dacStep);
+    genScanMultiLinkLocal(&la, outData.data(), ohMask, ohVfatMaskArray, NOH, ch, useCalPulse, currentPulse, calScaleFactor, nevts, dacMin, dacMax, dacStep, scanReg, useExtTrig);
+    setWordArray(request, response, "data", outData.data(), outData.size());
+
+    return;
+} //End genScanMultiLink(...)
+
 void sbitRateScanLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outDataTrigRate, uint32_t ohN, uint32_t maskOh, bool invertVFATPos, uint32_t ch, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep, std::string scanReg, uint32_t waitTime)
 {
     char regBuf[200];
@@ -575,6 +809,14 @@ void sbitRateScanLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outData
                 return;
             }
 
+            //Resolve the scan register before the hardware is modified
+            regInfo scanRegInfo;
+            std::string scanRegName = vfatRegName<V3Policy>(ohN, vfatN, "CFG_"+scanReg);
+            if (!getRegInfo(la, scanRegName, scanRegInfo)){
+                la->response->set_string("error", stdsprintf("Register %s not found", scanRegName.c_str()));
+                return;
+            }
+
             //If ch!=128 store the original channel mask settings
             //Then mask all other channels except for channel ch
             std::unordered_map<uint32_t, uint32_t> map_chanOrigMask; //key -> reg addr; val -> reg value
@@ -594,14 +836,15 @@ void sbitRateScanLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t *outData
             writeReg(la, "GEM_AMC.GEM_SYSTEM.VFAT3.SC_ONLY_MODE", 0x0);
 
             //Loop from dacMin to dacMax in steps of dacStep
+            scanJobLoop progress((dacMax-dacMin)/dacStep+1);
             for(uint32_t dacVal = dacMin; dacVal <= dacMax; dacVal += dacStep){
-                sprintf(regBuf,"GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_%s",ohN,vfatN,scanReg.c_str());
-                writeReg(la, regBuf, dacVal);
+                writeReg(la, scanRegInfo, dacVal);
                 std::this_thread::sleep_for(std::chrono::milliseconds(waitTime));
 
                 int idx = (dacVal-dacMin)/dacStep;
                 outDataDacVal[idx] = dacVal;
                 outDataTrigRate[idx] = readRawAddress(ohTrigRateAddr, la->response);
+                if (!progress.step(idx+1, dacVal, ch)) break;
             } //End Loop from dacMin to dacMax
 
             //Restore the original channel masks if specific channel was requested
@@ -638,6 +881,10 @@ void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t
                 return;
             }
 
+            //Resolve the scan registers before the hardware is modified
+            regArray scanRegs;
+            if (!getVFATRegArray(la, ohN, "CFG_"+scanReg, scanRegs)) return;
+
             //If ch!=128 store the original channel mask settings
             //Then mask all other channels except for channel ch
             std::unordered_map<uint32_t, uint32_t> map_chanOrigMask[24]; //key -> reg addr; val -> reg value
@@ -666,12 +913,12 @@ void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t
             writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.FPGA.TRIG.CNT.SBIT_CNT_TIME_MAX",ohN), 0x02638e98); //count for 1 second
 
             //Loop from dacMin to dacMax in steps of dacStep
+            scanJobLoop progress((dacMax-dacMin)/dacStep+1);
             for(uint32_t dacVal = dacMin; dacVal <= dacMax; dacVal += dacStep){
                 //Set the scan register value
                 for(int vfat=0; vfat<24; ++vfat){
                     if ( !( (notmask >> vfat) & 0x1)) continue;
-                    sprintf(regBuf,"GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_%s",ohN,vfat,scanReg.c_str());
-                    writeReg(la, regBuf, dacVal);
+                    writeReg(la, scanRegs.at(vfat), dacVal);
                 } //End Loop Over all VFATs
 
                 //Reset the counters
@@ -690,6 +937,7 @@ void sbitRateScanParallelLocal(localArgs *la, uint32_t *outDataDacVal, uint32_t
                     idx = vfat*(dacMax-dacMin+1)/dacStep+(dacVal-dacMin)/dacStep;
                     outDataTrigRatePerVFAT[idx] = readRawAddress(ohTrigRateAddr[vfat], la->response);
                 }
+                if (!progress.step((dacVal-dacMin)/dacStep+1, dacVal, ch)) break;
             } //End Loop from dacMin to dacMax
 
             //Restore the original channel masks if specific channel was requested
@@ -714,13 +962,10 @@ return;
 
 void sbitRateScan(const RPCMsg *request, RPCMsg *response)
 {
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    scanHardwareGuard hardware(response, false);
+    if (!hardware.locked()) return;
+
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t maskOh = request->get_word("maskOh");
@@ -733,7 +978,7 @@ void sbitRateScan(const RPCMsg *request, RPCMsg *response)
     uint32_t waitTime = request->get_word("waitTime");
     bool isParallel = request->get_word("isParallel");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     uint32_t outDataDacVal[(dacMax-dacMin+1)/dacStep];
     uint32_t outDataTrigRate[(dacMax-dacMin+1)/dacStep];
     if(isParallel){
@@ -817,12 +1062,20 @@ void checkSbitMappingWithCalPulseLocal(localArgs *la, uint32_t *outData, uint32_
     //mask all other vfats from trigger
     writeReg(la,stdsprintf("GEM_AMC.OH.OH%i.FPGA.TRIG.CTRL.VFAT_MASK",ohN), 0xffffff & ~(1 << (vfatN)));
 
+    //Resolve the run mode and channel mask registers of this vfat
+    regArray cfgRun, chanMask;
+    if (!getVFATRegArray(la, ohN, "CFG_RUN", cfgRun) || !getChannelRegArray(la, ohN, vfatN, "MASK", chanMask)){
+        return;
+    }
+
     //Place this vfat into run mode
-    writeReg(la,stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_RUN",ohN, vfatN), 0x1);
+    writeReg(la, cfgRun.at(vfatN), 0x1);
 
+    scanJobLoop progress(128);
     for(int chan=0; chan < 128; ++chan){ //Loop over all channels
+        if (!progress.step(chan, 0, chan)) break;
         //unmask this channel
-        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.MASK",ohN,vfatN,chan), 0x0);
+        writeReg(la, chanMask.at(chan), 0x0);
 
         //Turn on the calpulse for this channel
         if (confCalPulseLocal(la, ohN, ~((0x1)<<vfatN) & 0xFFFFFF, chan, useCalPulse, currentPulse, calScaleFactor) == false){
@@ -877,11 +1130,11 @@ void checkSbitMappingWithCalPulseLocal(localArgs *la, uint32_t *outData, uint32_
         }
 
         //mask this channel
-        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.MASK",ohN,vfatN,chan), 0x1);
+        writeReg(la, chanMask.at(chan), 0x1);
     } //End Loop over all channels
 
     //Place this vfat out of run mode
-    writeReg(la,stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_RUN",ohN, vfatN), 0x0);
+    writeReg(la, cfgRun.at(vfatN), 0x0);
     //} //End Loop over all VFATs
 
     //turn off TTC Generator
@@ -897,13 +1150,12 @@ void checkSbitMappingWithCalPulseLocal(localArgs *la, uint32_t *outData, uint32_
 } //End checkSbitMappingWithCalPulseLocal(...)
 
 void checkSbitMappingWithCalPulse(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    scanHardwareGuard hardware(response, false);
+    if (!hardware.locked()) return;
+    sbitMonitorGuard sbitMonitor(response, "checkSbitMappingWithCalPulse");
+    if (!sbitMonitor.locked()) return;
+
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t vfatN = request->get_word("vfatN");
@@ -915,7 +1167,7 @@ void checkSbitMappingWithCalPulse(const RPCMsg *request, RPCMsg *response){
     uint32_t L1Ainterval = request->get_word("L1Ainterval");
     uint32_t pulseDelay = request->get_word("pulseDelay");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     uint32_t outData[128*8*nevts];
     checkSbitMappingWithCalPulseLocal(&la, outData, ohN, vfatN, mask, useCalPulse, currentPulse, calScaleFactor, nevts, L1Ainterval, pulseDelay);
 
@@ -1004,15 +1256,23 @@ void checkSbitRateWithCalPulseLocal(localArgs *la, uint32_t *outDataCTP7Rate, ui
     LOGGER->log_message(LogManager::INFO, stdsprintf("Masking VFATs %x from trigger in ohN %i", 0xffffff & ~(1 << (vfatN)), ohN));
     writeReg(la,stdsprintf("GEM_AMC.OH.OH%i.FPGA.TRIG.CTRL.VFAT_MASK",ohN), 0xffffff & ~(1 << (vfatN)));
 
+    //Resolve the run mode and channel mask registers of this vfat
+    regArray cfgRun, chanMask;
+    if (!getVFATRegArray(la, ohN, "CFG_RUN", cfgRun) || !getChannelRegArray(la, ohN, vfatN, "MASK", chanMask)){
+        return;
+    }
+
     //Place this vfat into run mode
     LOGGER->log_message(LogManager::INFO, stdsprintf("Placing vfatN %i on ohN %i in run mode", vfatN, ohN));
-    writeReg(la,stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_RUN",ohN, vfatN), 0x1);
+    writeReg(la, cfgRun.at(vfatN), 0x1);
 
     LOGGER->log_message(LogManager::INFO, stdsprintf("Looping over all channels of vfatN %i on ohN %i", vfatN, ohN));
+    scanJobLoop progress(128);
     for(int chan=0; chan < 128; ++chan){ //Loop over all channels
+        if (!progress.step(chan, 0, chan)) break;
         //unmask this channel
         LOGGER->log_message(LogManager::INFO, stdsprintf("Unmasking channel %i on vfat %i of OH %i", chan, vfatN, ohN));
-        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.MASK",ohN,vfatN,chan), 0x0);
+        writeReg(la, chanMask.at(chan), 0x0);
 
         //Turn on the calpulse for this channel
         LOGGER->log_message(LogManager::INFO, stdsprintf("Enabling calpulse for channel %i on vfat %i of OH %i", chan, vfatN, ohN));
@@ -1057,12 +1317,12 @@ void checkSbitRateWithCalPulseLocal(localArgs *la, uint32_t *outDataCTP7Rate, ui
 
         //mask this channel
         LOGGER->log_message(LogManager::INFO, stdsprintf("Masking channel %i on vfat %i of OH %i", chan, vfatN, ohN));
-        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i.MASK",ohN,vfatN,chan), 0x1);
+        writeReg(la, chanMask.at(chan), 0x1);
     } //End Loop over all channels
 
     //Place this vfat out of run mode
     LOGGER->log_message(LogManager::INFO, stdsprintf("Finished looping over all channels.  Taking vfatN %i on ohN %i out of run mode", vfatN, ohN));
-    writeReg(la,stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_RUN",ohN, vfatN), 0x0);
+    writeReg(la, cfgRun.at(vfatN), 0x0);
 
     //turn off TTC Generator
     LOGGER->log_message(LogManager::INFO, "Disabling TTC Generator");
@@ -1080,13 +1340,10 @@ void checkSbitRateWithCalPulseLocal(localArgs *la, uint32_t *outDataCTP7Rate, ui
 } //End checkSbitRateWithCalPulseLocal()
 
 void checkSbitRateWithCalPulse(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    scanHardwareGuard hardware(response, false);
+    if (!hardware.locked()) return;
+
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t vfatN = request->get_word("vfatN");
@@ -1098,7 +1355,7 @@ void checkSbitRateWithCalPulse(const RPCMsg *request, RPCMsg *response){
     uint32_t pulseRate = request->get_word("pulseRate");
     uint32_t pulseDelay = request->get_word("pulseDelay");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     uint32_t outDataCTP7Rate[128];
     uint32_t outDataFPGAClusterCntRate[128];
     uint32_t outDataVFATSBits[128];
@@ -1111,13 +1368,46 @@ void checkSbitRateWithCalPulse(const RPCMsg *request, RPCMsg *response){
     return;
 } //End checkSbitRateWithCalPulse()
 
-std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSelect, uint32_t dacStep, uint32_t mask, bool useExtRefADC){
+/*! \struct dacScanLink
+ *  Optohybrid scanned by dacScanLinksLocal
+ */
+struct dacScanLink {
+    uint32_t ohN;
+    uint32_t mask; /*!< VFAT mask */
+    regArray dacRegs, adcRegs, adcCacheUpdateRegs;
+    std::vector<uint32_t> data; /*!< Results in the layout of dacScanLocal, empty if the link could not be scanned */
+};
+
+/*! \brief Results of links in the layout of dacScanMultiLink: NOH blocks of linkWords words, zero for the optohybrids that were not scanned.
+ *         With NOH 0 the results of the links are only concatenated */
+static std::vector<uint32_t> dacScanLinksResults(const std::vector<dacScanLink> & links, unsigned int NOH, size_t linkWords){
+    std::vector<uint32_t> results;
+    if(NOH == 0){
+        for(auto & link : links) results.insert(results.end(), link.data.begin(), link.data.end());
+        return results;
+    }
+    results.reserve(NOH*linkWords);
+    auto link = links.begin();
+    for(unsigned int ohN=0; ohN<NOH; ++ohN){
+        if(link == links.end() || link->ohN != ohN || link->data.empty()){
+            results.resize(results.size() + linkWords);
+        }
+        else results.insert(results.end(), link->data.begin(), link->data.end());
+        if(link != links.end() && link->ohN == ohN) ++link;
+    }
+    return results;
+} //End dacScanLinksResults(...)
+
+/*! \brief dacScanLocal of several optohybrids at once: the links are configured and put in run mode together, so that they share
+ *         the settling time, then each DAC value is written and each ADC read is done on the VFATs of all links in one batch.
+ *         A link whose VFATs are not synchronized is not scanned, an error is then set in the response.
+ *         In a scan job the results are published after each DAC value, in the layout of dacScanLinksResults with NOH */
+static void dacScanLinksLocal(localArgs *la, std::vector<dacScanLink> & links, uint32_t dacSelect, uint32_t dacStep, bool useExtRefADC, uint32_t nReads, uint32_t adcTolerance, unsigned int NOH){
     //Ensure VFAT3 Hardware
     if(fw_version_check("dacScanLocal", la) < 3){
         LOGGER->log_message(LogManager::ERROR, "dacScanLocal is only supported in V3 electronics");
         la->response->set_string("error","dacScanLocal is only supported in V3 electronics");
-        std::vector<uint32_t> emptyVec;
-        return emptyVec;
+        return;
     }
 
     vfat3DACAndSize dacInfo;
@@ -1131,161 +1421,200 @@ std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSele
             errMsg+="\t" + std::to_string((*iterDacSel).first) + "\t" + std::get<0>((*iterDacSel).second) + "\n";
         }
         la->response->set_string("error",errMsg);
-        std::vector<uint32_t> emptyVec;
-        return emptyVec;
+        return;
     } //End Case: dacSelect not found, exit
 
-    //Check which VFATs are sync'd
-    uint32_t notmask = ~mask & 0xFFFFFF; //Inverse of the vfatmask
-    uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
-    if( (notmask & goodVFATs) != notmask){
-        la->response->set_string("error",stdsprintf("One of the unmasked VFATs is not Synced. goodVFATs: %x\tnotmask: %x",goodVFATs,notmask));
-        std::vector<uint32_t> emptyVec;
-        return emptyVec;
-    }
-
-    //Determine the addresses
     std::string regName = std::get<0>(map_dacSelect[dacSelect]);
     LOGGER->log_message(LogManager::INFO, stdsprintf("Scanning DAC: %s",regName.c_str()));
-    uint32_t adcAddr[24];
-    uint32_t adcCacheUpdateAddr[24];
-    bool foundAdcCached=false;
-    for(int vfatN=0; vfatN<24; ++vfatN){
-        //Skip Masked VFATs
-        if ( !( (notmask >> vfatN) & 0x1)) continue;
-
-        //Determine Register Base string
-        std::string strRegBase = stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.",ohN,vfatN);
-
-        //Get ADC address
-        if(useExtRefADC){ //Case: Use ADC with external reference
-            //for backward compatibility, use ADC1 instead of ADC1_CACHED if it exists
-            lmdb::val key, db_res;
-
-            key.assign(strRegBase+"ADC1_CACHED");
-            foundAdcCached = la->dbi.get(la->rtxn,key,db_res);
-            if(foundAdcCached){
-                adcAddr[vfatN] = getAddress(la, strRegBase + "ADC1_CACHED");
-                adcCacheUpdateAddr[vfatN] = getAddress(la, strRegBase + "ADC1_UPDATE");                
-            }
-            else
-                adcAddr[vfatN] = getAddress(la, strRegBase + "ADC1");
-        } //End Case: Use ADC with external reference
-        else{ //Case: Use ADC with internal reference
-            //for backward compatibility, use ADC0 instead of ADC0_CACHED if it exists
-            lmdb::val key, db_res;
-            key.assign(strRegBase+"ADC0_CACHED");
-            foundAdcCached = la->dbi.get(la->rtxn,key,db_res);
-            if(foundAdcCached) {
-                adcAddr[vfatN] = getAddress(la, strRegBase + "ADC0_CACHED");
-                adcCacheUpdateAddr[vfatN] = getAddress(la, strRegBase + "ADC0_UPDATE");
-            }
-            else
-                adcAddr[vfatN] = getAddress(la, strRegBase + "ADC0");
-        } //End Case: Use ADC with internal reference
-    } //End Loop over VFATs
-
-    //make the output container and correctly size it
+    std::string adcName = useExtRefADC ? "ADC1" : "ADC0"; //ADC with external or internal reference
+    //for backward compatibility, use ADCx instead of ADCx_CACHED if the latter does not exist
+    bool foundAdcCached = getFwCapabilities(la).hasAdcCached;
     uint32_t dacMax = std::get<2>(map_dacSelect[dacSelect]);
     uint32_t dacMin = std::get<1>(map_dacSelect[dacSelect]);
     int nDacValues = (dacMax-dacMin+1)/dacStep;
-    std::vector<uint32_t> vec_dacScanData(24*nDacValues); //Each element has bits [0:7] as the current dacValue, and bits [8:17] as the ADC read back value
 
-    //Configure the DAC Monitoring on all the VFATs
-    configureVFAT3DacMonitorLocal(la, ohN, mask, dacSelect);
+    std::vector<dacScanLink*> scanned;
+    for(auto & link : links){
+        //Check which VFATs are sync'd
+        uint32_t notmask = ~link.mask & 0xFFFFFF; //Inverse of the vfatmask
+        uint32_t goodVFATs = vfatSyncCheckLocal(la, link.ohN);
+        if( (notmask & goodVFATs) != notmask){
+            la->response->set_string("error",stdsprintf("One of the unmasked VFATs of OH%i is not Synced. goodVFATs: %x\tnotmask: %x",link.ohN,goodVFATs,notmask));
+            continue;
+        }
+
+        //Determine the addresses
+        bool foundRegs = getVFATRegArray(la, link.ohN, regName, link.dacRegs);
+        if(foundAdcCached){
+            foundRegs = foundRegs && getVFATRegArray(la, link.ohN, adcName+"_CACHED", link.adcRegs);
+            foundRegs = foundRegs && getVFATRegArray(la, link.ohN, adcName+"_UPDATE", link.adcCacheUpdateRegs);
+        }
+        else
+            foundRegs = foundRegs && getVFATRegArray(la, link.ohN, adcName, link.adcRegs);
+        if(!foundRegs) continue;
+
+        //make the output container and correctly size it
+        link.data.assign(24*nDacValues, 0); //Each element has bits [0:7] as the current dacValue, and bits [8:17] as the ADC read back value
+
+        //Configure the DAC Monitoring on all the VFATs
+        configureVFAT3DacMonitorLocal(la, link.ohN, link.mask, dacSelect);
+        scanned.push_back(&link);
+    }
+    if(scanned.empty()) return;
 
     //Take the VFATs out of slow control only mode
     writeReg(la, "GEM_AMC.GEM_SYSTEM.VFAT3.SC_ONLY_MODE", 0x0);
 
-    //Set the VFATs into Run Mode
-    broadcastWriteLocal(la, ohN, "CFG_RUN", 0x1, mask);
-    LOGGER->log_message(LogManager::INFO, stdsprintf("VFATs not in 0x%x were set to run mode", mask));
+    //Set the VFATs of all links into Run Mode
+    for(auto link : scanned){
+        broadcastWriteLocal(la, link->ohN, "CFG_RUN", 0x1, link->mask);
+        LOGGER->log_message(LogManager::INFO, stdsprintf("VFATs of OH%i not in 0x%x were set to run mode", link->ohN, link->mask));
+    }
     std::this_thread::sleep_for(std::chrono::seconds(1)); //I noticed that DAC values behave weirdly immediately after VFAT is placed in run mode (probably voltage/current takes a moment to stabalize)
 
     //Scan the DAC
+    if(nReads == 0) nReads = 1;
+    const uint32_t minReads = std::min(nReads, 8u); //reads taken before the spread of the ADC values is trusted
+    const size_t nVFATs = 24*scanned.size(); //VFAT k is VFAT k%24 of link k/24
+
+    //The DAC of all VFATs is written at once, then the ADCs of all VFATs are read in one batch per read.
+    //With the ADC cache each batch reads the values converted after the previous batch and triggers the next conversion,
+    //so that one cache update time is waited per read for all VFATs together
+    regBatch dacWrites;
+    std::vector<bool> unmasked(nVFATs);
+    for(size_t k=0; k<nVFATs; ++k){
+        unmasked[k] = !((scanned[k/24]->mask >> (k%24)) & 0x1);
+        if (unmasked[k]) dacWrites.write(scanned[k/24]->dacRegs.at(k%24), 0);
+    }
 
-    uint32_t nReads=100;
+    scanJobLoop progress((dacMax-dacMin)/dacStep+1);
     for(uint32_t dacVal=dacMin; dacVal<=dacMax; dacVal += dacStep){ //Loop over DAC values
-        for(int vfatN=0; vfatN<24; ++vfatN){ //Loop over VFATs
-            //Skip masked VFATs
-            if ( !( (notmask >> vfatN) & 0x1)){ //Case: VFAT is masked, skip
-                //Store word, but with adcVal = 0
-                int idx = vfatN*(dacMax-dacMin+1)/dacStep+(dacVal-dacMin)/dacStep;
-                vec_dacScanData[idx] = ((ohN & 0xf) << 23) + ((vfatN & 0x1f) << 18) + (dacVal & 0xff);
+        //Set DAC value
+        for(auto & write : dacWrites.entries) write.value = dacVal;
+        if(dacWrites.execute(la)){
+            la->response->set_string("error", stdsprintf("Unable to write %s to %i", regName.c_str(), dacVal));
+            break;
+        }
 
-                //skip
-                continue;
-            } //End Case: VFAT is masked, skip
-            else{ //Case: VFAT is not masked
-            //Set DAC value
-                std::string strDacReg = stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.",ohN,vfatN) + regName;
-                writeReg(la, strDacReg, dacVal);
-                //Read nReads times and take avg value
-                uint32_t adcVal=0;
-                for(int i=0; i<nReads; ++i){
-                    //Read the ADC
-                    if (foundAdcCached){
-                        //either reading or writing this register will trigger a cache update
-                        readRawAddress(adcCacheUpdateAddr[vfatN], la->response);
-                        //updating the cache takes 20 us, including a 50% safety factor
-                        std::this_thread::sleep_for(std::chrono::microseconds(20));
+        //Read nReads times and take avg value, VFATs whose mean is known within adcTolerance are not read anymore
+        std::vector<bool> active(unmasked);
+        size_t nActive = std::count(active.begin(), active.end(), true);
+        std::vector<uint64_t> adcSum(nVFATs), adcSumSq(nVFATs);
+        std::vector<uint32_t> nValid(nVFATs);
+        std::vector<int> adcIdx(nVFATs);
+        for(uint32_t i=0; i<=nReads && nActive; ++i){
+            regBatch adcReads;
+            for(size_t k=0; k<nVFATs; ++k){
+                adcIdx[k] = -1;
+                if (!active[k]) continue;
+                const dacScanLink *link = scanned[k/24];
+                if (foundAdcCached){
+                    //reading the cache before the first update would give the value of the previous DAC setting
+                    if (i > 0) adcIdx[k] = adcReads.read(link->adcRegs.at(k%24));
+                    //either reading or writing this register will trigger a cache update
+                    if (i < nReads) adcReads.read(link->adcCacheUpdateRegs.at(k%24));
+                }
+                else if (i < nReads){
+                    adcIdx[k] = adcReads.read(link->adcRegs.at(k%24));
+                }
+            }
+            if (adcReads.entries.empty()) break;
+            adcReads.execute(la);
+
+            for(size_t k=0; k<nVFATs; ++k){
+                if (adcIdx[k] < 0) continue;
+                uint32_t adc = adcReads.result(adcIdx[k]);
+                if (adc != 0xdeaddead){
+                    adcSum[k] += adc;
+                    adcSumSq[k] += (uint64_t)adc*adc;
+                    ++nValid[k];
+                }
+
+                //Stop reading once twice the standard error of the mean is within the tolerance
+                if (adcTolerance && nValid[k] >= minReads){
+                    double mean = double(adcSum[k])/nValid[k];
+                    double variance = std::max(0., double(adcSumSq[k])/nValid[k]-mean*mean);
+                    if (4*variance/nValid[k] <= double(adcTolerance)*adcTolerance){
+                        active[k] = false; //a cache update triggered by this batch is left unread
+                        --nActive;
                     }
-                    adcVal += readRawAddress(adcAddr[vfatN], la->response);
                 }
-                adcVal = adcVal/nReads;
-                //Store value
-                int idx = vfatN*(dacMax-dacMin+1)/dacStep+(dacVal-dacMin)/dacStep;
-                vec_dacScanData[idx] = ((ohN & 0xf) << 23) + ((vfatN & 0x1f) << 18) + ((adcVal & 0x3ff) << 8) + (dacVal & 0xff);
-            } //End Case: VFAT is not masked
+            }
+
+            //updating the cache takes 20 us, including a 50% safety factor
+            if (foundAdcCached && i < nReads && nActive) std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+
+        for(size_t k=0; k<nVFATs; ++k){
+            dacScanLink *link = scanned[k/24];
+            uint32_t ohN = link->ohN, vfatN = k%24;
+            int idx = vfatN*(dacMax-dacMin+1)/dacStep+(dacVal-dacMin)/dacStep;
+            if (!unmasked[k]){ //Case: VFAT is masked, store word, but with adcVal = 0
+                link->data[idx] = ((ohN & 0xf) << 23) + ((vfatN & 0x1f) << 18) + (dacVal & 0xff);
+                continue;
+            }
+            uint32_t adcVal = nValid[k] ? adcSum[k]/nValid[k] : 0;
+            if (nValid[k] < nReads) LOGGER->log_message(LogManager::DEBUG, stdsprintf("%s %i: %i ADC reads of VFAT%i on OH%i", regName.c_str(), dacVal, nValid[k], vfatN, ohN));
+            //Store value
+            link->data[idx] = ((ohN & 0xf) << 23) + ((vfatN & 0x1f) << 18) + ((adcVal & 0x3ff) << 8) + (dacVal & 0xff);
         } //End Loop over VFATs
+        bool more = progress.step((dacVal-dacMin)/dacStep+1, dacVal, 0);
+        if (progress.outermost()){
+            std::vector<uint32_t> partial = dacScanLinksResults(links, NOH, (dacMax+1)*24/dacStep);
+            scanJobPartial(partial.data(), partial.size());
+        }
+        if (!more) break;
     } //End Loop over DAC values
 
-
     //Take the VFATs out of Run Mode
-    broadcastWriteLocal(la, ohN, "CFG_RUN", 0x0, mask);
-
-    return vec_dacScanData;
+    for(auto link : scanned) broadcastWriteLocal(la, link->ohN, "CFG_RUN", 0x0, link->mask);
+} //End dacScanLinksLocal(...)
+
+std::vector<uint32_t> dacScanLocal(localArgs *la, uint32_t ohN, uint32_t dacSelect, uint32_t dacStep, uint32_t mask, bool useExtRefADC, uint32_t nReads, uint32_t adcTolerance){
+    std::vector<dacScanLink> links(1);
+    links[0].ohN = ohN;
+    links[0].mask = mask;
+    dacScanLinksLocal(la, links, dacSelect, dacStep, useExtRefADC, nReads, adcTolerance, 0);
+    return links[0].data;
 } //End dacScanLocal(...)
 
 void dacScan(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    scanHardwareGuard hardware(response, false);
+    if (!hardware.locked()) return;
+
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t dacSelect = request->get_word("dacSelect");
     uint32_t dacStep = request->get_word("dacStep");
     uint32_t mask = request->get_word("mask");
     bool useExtRefADC = request->get_word("useExtRefADC");
+    uint32_t nReads = request->get_key_exists("nReads") ? request->get_word("nReads") : 100;
+    uint32_t adcTolerance = request->get_key_exists("adcTolerance") ? request->get_word("adcTolerance") : 0;
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
-    std::vector<uint32_t> dacScanResults = dacScanLocal(&la, ohN, dacSelect, dacStep, mask, useExtRefADC);
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
+    std::vector<uint32_t> dacScanResults = dacScanLocal(&la, ohN, dacSelect, dacStep, mask, useExtRefADC, nReads, adcTolerance);
     response->set_word_array("dacScanResults",dacScanResults);
 
     return;
 } //End dacScan(...)
 
 void dacScanMultiLink(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    scanHardwareGuard hardware(response, false);
+    if (!hardware.locked()) return;
+
+    addressTableTxn atxn;
 
     uint32_t ohMask = request->get_word("ohMask");
     uint32_t dacSelect = request->get_word("dacSelect");
     uint32_t dacStep = request->get_word("dacStep");
     bool useExtRefADC = request->get_word("useExtRefADC");
+    uint32_t nReads = request->get_key_exists("nReads") ? request->get_word("nReads") : 100;
+    uint32_t adcTolerance = request->get_key_exists("adcTolerance") ? request->get_word("adcTolerance") : 0;
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
 
-    unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+    unsigned int NOH = getFwCapabilities(&la).numOfOH;
     if (request->get_key_exists("NOH")){
         unsigned int NOH_requested = request->get_word("NOH");
         if (NOH_requested <= NOH)
@@ -1294,35 +1623,27 @@ void dacScanMultiLink(const RPCMsg *request, RPCMsg *response){
             LOGGER->log_message(LogManager::WARNING, stdsprintf("NOH requested (%i) > NUM_OF_OH AMC register value (%i), NOH request will be disregarded",NOH_requested,NOH));
     }
 
-    vfat3DACAndSize dacInfo;
-    std::vector<uint32_t> dacScanResultsAll;
+    //Get the vfatmask of all OHs, then scan all OHs together
+    std::vector<dacScanLink> links;
     for(unsigned int ohN=0; ohN<NOH; ++ohN){
-        std::vector<uint32_t> dacScanResults;
-
         // If this Optohybrid is masked skip it
-        if(!((ohMask >> ohN) & 0x1)){
-            int dacMax = std::get<2>(dacInfo.map_dacInfo[dacSelect]);
-            dacScanResults.resize( (dacMax+1)*24/dacStep );
-            std::copy(dacScanResults.begin(), dacScanResults.end(), std::back_inserter(dacScanResultsAll));
-            continue;
-        }
-
-        //Get vfatmask for this OH
-        LOGGER->log_message(LogManager::INFO, stdsprintf("Getting VFAT Mask for OH%i", ohN));
-        uint32_t vfatMask = getOHVFATMaskLocal(&la, ohN);
-
-        //Get dac scan results for this optohybrid
-        LOGGER->log_message(LogManager::INFO, stdsprintf("Performing DAC Scan for OH%i", ohN));
-        dacScanResults = dacScanLocal(&la, ohN, dacSelect, dacStep, vfatMask, useExtRefADC);
+        if(!((ohMask >> ohN) & 0x1)) continue;
+        dacScanLink link;
+        link.ohN = ohN;
+        link.mask = getOHVFATMaskLocal(&la, ohN);
+        LOGGER->log_message(LogManager::INFO, stdsprintf("Determined VFAT Mask for OH%i to be 0x%x", ohN, link.mask));
+        links.push_back(link);
+    } //End Loop over all Optohybrids
 
-        //Copy the results into the final container
-        LOGGER->log_message(LogManager::INFO, stdsprintf("Storing results of DAC scan for OH%i", ohN));
-        std::copy(dacScanResults.begin(), dacScanResults.end(), std::back_inserter(dacScanResultsAll));
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Performing DAC Scan for OH Mask 0x%x", ohMask));
+    dacScanLinksLocal(&la, links, dacSelect, dacStep, useExtRefADC, nReads, adcTolerance, NOH);
 
-        LOGGER->log_message(LogManager::INFO, stdsprintf("Finished DAC scan for OH%i", ohN));
-    } //End Loop over all Optohybrids
+    //Copy the results into the final container
+    vfat3DACAndSize dacInfo;
+    int dacMax = std::get<2>(dacInfo.map_dacInfo[dacSelect]);
+    std::vector<uint32_t> dacScanResultsAll = dacScanLinksResults(links, NOH, (dacMax+1)*24/dacStep);
 
-    response->set_word_array("dacScanResultsAll",dacScanResultsAll);
+    setWordArray(request, response, "dacScanResultsAll", dacScanResultsAll.data(), dacScanResultsAll.size());
     LOGGER->log_message(LogManager::INFO, stdsprintf("Finished DAC scans for OH Mask 0x%x", ohMask));
 
     return;
@@ -1330,13 +1651,10 @@ void dacScanMultiLink(const RPCMsg *request, RPCMsg *response){
 
 void genChannelScan(const RPCMsg *request, RPCMsg *response)
 {
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    scanHardwareGuard hardware(response, false);
+    if (!hardware.locked()) return;
+
+    addressTableTxn atxn;
 
     uint32_t nevts = request->get_word("nevts");
     uint32_t ohN = request->get_word("ohN");
@@ -1355,17 +1673,418 @@ void genChannelScan(const RPCMsg *request, RPCMsg *response)
         useUltra = true;
     }
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
-    uint32_t outData[128*24*(dacMax-dacMin+1)/dacStep];
-    for(uint32_t ch = 0; ch < 128; ch++)
-    {
-        genScanLocal(&la, &(outData[ch*24*(dacMax-dacMin+1)/dacStep]), ohN, mask, ch, useCalPulse, currentPulse, calScaleFactor, nevts, dacMin, dacMax, dacStep, scanReg, useUltra, useExtTrig);
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
+    std::vector<uint32_t> outData(128*24*(dacMax-dacMin+1)/dacStep);
+    scanJobLoop progress(128);
+    if (fw_version_check("genChannelScan", &la) == 3){
+        //Check the links and resolve the registers once for all channels
+        genScanLink link = {ohN, mask, outData.data(), regArray()};
+        std::vector<genScanLink> links(1, link);
+        genScanRegs regs;
+        if (!genScanV3Setup(&la, links, regs, scanReg, currentPulse, calScaleFactor)) return;
+        for(uint32_t ch = 0; ch < 128 && !response->get_key_exists("error"); ch++)
+        {
+            links[0].outData = &(outData[ch*24*(dacMax-dacMin+1)/dacStep]);
+            genScanV3Local(&la, links, regs, outData.data(), outData.size(), ch, useCalPulse, currentPulse, calScaleFactor, nevts, dacMin, dacMax, dacStep, useExtTrig);
+            bool more = progress.step(ch+1, dacMax, ch);
+            scanJobPartial(outData.data(), (ch+1)*24*(dacMax-dacMin+1)/dacStep);
+            if (!more) break;
+        }
     }
-    response->set_word_array("data",outData,24*128*(dacMax-dacMin+1)/dacStep);
+    else{
+        for(uint32_t ch = 0; ch < 128; ch++)
+        {
+            genScanLocal(&la, &(outData[ch*24*(dacMax-dacMin+1)/dacStep]), ohN, mask, ch, useCalPulse, currentPulse, calScaleFactor, nevts, dacMin, dacMax, dacStep, scanReg, useUltra, useExtTrig);
+            bool more = progress.step(ch+1, dacMax, ch);
+            scanJobPartial(outData.data(), (ch+1)*24*(dacMax-dacMin+1)/dacStep);
+            if (!more) break;
+        }
+    }
+    setWordArray(request, response, "data", outData.data(), 24*128*(dacMax-dacMin+1)/dacStep);
 
     return;
 }
 
+#define SCAN_JOBS_SHM_NAME "/ctp7_scan_jobs"
+#define SCAN_JOBS_MAGIC 0x534a5432 // "SJT2"
+#define SCAN_JOB_SLOTS 16
+#define SCAN_JOB_MAX_DEPTH 8
+#define SCAN_JOB_EXPIRY_S 86400 // finished jobs that were not released are reused after a day
+#define SCAN_JOB_CANCEL_GRACE_S 60 // a cancelled worker which did not stop by itself within this time is terminated
+
+enum scanJobState {
+    SCAN_JOB_FREE = 0,
+    SCAN_JOB_QUEUED = 1,
+    SCAN_JOB_RUNNING = 2,
+    SCAN_JOB_DONE = 3,
+    SCAN_JOB_FAILED = 4,
+    SCAN_JOB_CANCELLED = 5
+};
+
+/*! \struct scanJobSlot
+ *  Scan job in the job table. Slots are allocated and freed, cancellations are requested and final states are written with the table lock held.
+ *  The progress is written by the worker only
+ */
+struct scanJobSlot {
+    uint32_t id; /*!< Job identifier, never reused */
+    volatile pid_t worker; /*!< Worker process */
+    volatile uint32_t state; /*!< scanJobState */
+    char method[64]; /*!< Scan method */
+    char error[256]; /*!< Error of a failed job */
+    time_t submitTime;
+    volatile time_t startTime; /*!< Time the worker got the hardware */
+    volatile time_t endTime;
+    volatile uint32_t progressPpm; /*!< Fraction done, in parts per million */
+    volatile uint32_t dacVal; /*!< Current DAC value */
+    volatile uint32_t channel; /*!< Current channel */
+    volatile uint32_t partialWords; /*!< Size of the last published partial results */
+    volatile uint32_t cancelRequested; /*!< Set by cancelScanJob, the scan stops at its next loop step */
+    volatile time_t cancelTime; /*!< Time of the cancel request */
+};
+
+/*! \struct scanJobTable
+ *  Scan jobs of the card, shared by all the RPC processes. The results are kept in one shared memory segment per job
+ */
+struct scanJobTable {
+    uint32_t magic;
+    uint32_t nextId;
+    scanJobSlot slot[SCAN_JOB_SLOTS];
+};
+
+static scanJobTable *scanJobs = NULL;
+static scanJobSlot *currentJob = NULL; //job run by this process, if it is a scan job worker
+static int scanJobDepth = 0;
+static bool scanJobInterrupted = false; //a scan loop of this worker stopped on a cancel request
+static uint32_t scanJobDone[SCAN_JOB_MAX_DEPTH];
+static uint32_t scanJobTotal[SCAN_JOB_MAX_DEPTH];
+
+scanJobLoop::scanJobLoop(uint32_t total) : depth(scanJobDepth) {
+    if (depth < SCAN_JOB_MAX_DEPTH) {
+        scanJobDone[depth] = 0;
+        scanJobTotal[depth] = total ? total : 1;
+    }
+    ++scanJobDepth;
+}
+
+scanJobLoop::~scanJobLoop() {
+    --scanJobDepth;
+}
+
+bool scanJobLoop::step(uint32_t done, uint32_t dacVal, uint32_t channel) {
+    if (currentJob == NULL) return true;
+    if (currentJob->cancelRequested) {
+        scanJobInterrupted = true;
+        return false;
+    }
+    if (depth >= SCAN_JOB_MAX_DEPTH) return true;
+    scanJobDone[depth] = done;
+    double progress = 0, scale = 1;
+    for (int i = 0; i <= depth; ++i) {
+        scale /= scanJobTotal[i];
+        progress += scanJobDone[i]*scale;
+    }
+    currentJob->progressPpm = std::min(progress, 1.0)*1000000;
+    currentJob->dacVal = dacVal;
+    currentJob->channel = channel;
+    return true;
+}
+
+bool scanJobCancelRequested() {
+    return currentJob != NULL && currentJob->cancelRequested;
+}
+
+static std::string scanJobDataName(uint32_t id, const char *kind) {
+    return stdsprintf("/ctp7_scan_job%u_%s", id, kind);
+}
+
+static bool writeScanJobData(uint32_t id, const char *kind, const void *data, size_t size) {
+    int fd = shm_open(scanJobDataName(id, kind).c_str(), O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd < 0) return false;
+    bool ok = ftruncate(fd, size) == 0 && pwrite(fd, data, size, 0) == (ssize_t)size;
+    close(fd);
+    return ok;
+}
+
+static bool readScanJobData(uint32_t id, const char *kind, std::string & data) {
+    int fd = shm_open(scanJobDataName(id, kind).c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok) {
+        data.resize(st.st_size);
+        ok = pread(fd, &data[0], st.st_size, 0) == st.st_size;
+    }
+    close(fd);
+    return ok;
+}
+
+void scanJobPartial(const uint32_t *data, uint32_t count) {
+    if (currentJob == NULL) return;
+    if (writeScanJobData(currentJob->id, "partial", data, count*sizeof(uint32_t))) currentJob->partialWords = count;
+}
+
+static scanJobTable *openScanJobs(RPCMsg *response) {
+    if (scanJobs != NULL) return scanJobs;
+    int fd = shm_open(SCAN_JOBS_SHM_NAME, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (st.st_size < (off_t)sizeof(scanJobTable) && ftruncate(fd, sizeof(scanJobTable)) != 0)) {
+        if (fd >= 0) close(fd);
+        response->set_string("error", stdsprintf("Unable to open the scan job table: %s", strerror(errno)));
+        return NULL;
+    }
+    void *addr = mmap(NULL, sizeof(scanJobTable), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        response->set_string("error", stdsprintf("Unable to map the scan job table: %s", strerror(errno)));
+        return NULL;
+    }
+    scanJobs = (scanJobTable *)addr;
+    return scanJobs;
+}
+
+/*! \class scanJobsGuard
+ *  Opens the job table and holds its named lock in scope
+ */
+class scanJobsGuard {
+    public:
+        scanJobsGuard(RPCMsg *response) : table(openScanJobs(response)), lockid(-1) {
+            static int id = namedlock_init("calibration_routines", "scanJobs");
+            if (table == NULL) return;
+            if (id < 0 || namedlock_lock(id) != 0) {
+                response->set_string("error", "Unable to lock the scan job table");
+                table = NULL;
+                return;
+            }
+            lockid = id;
+            if (table->magic != SCAN_JOBS_MAGIC) {
+                memset(table, 0, sizeof(scanJobTable));
+                table->magic = SCAN_JOBS_MAGIC;
+            }
+        }
+        ~scanJobsGuard() {
+            if (lockid >= 0) namedlock_unlock(lockid);
+        }
+
+        /*! \brief Returns the slot of job id, NULL and an error in the response if not found.
+         *         A job whose worker died is marked as failed */
+        scanJobSlot *find(uint32_t id, RPCMsg *response) {
+            for (int i = 0; table && i < SCAN_JOB_SLOTS; ++i) {
+                scanJobSlot *job = &table->slot[i];
+                if (job->state == SCAN_JOB_FREE || job->id != id) continue;
+                if ((job->state == SCAN_JOB_QUEUED || job->state == SCAN_JOB_RUNNING) && job->worker > 0 && kill(job->worker, 0) != 0 && errno == ESRCH) {
+                    snprintf(job->error, sizeof(job->error), "The worker process %i died", job->worker);
+                    job->endTime = time(NULL);
+                    job->state = SCAN_JOB_FAILED;
+                }
+                return job;
+            }
+            response->set_string("error", stdsprintf("Scan job %u not found", id));
+            return NULL;
+        }
+
+        scanJobTable *table;
+
+    private:
+        int lockid;
+};
+
+static void releaseScanJob(scanJobSlot *job) {
+    shm_unlink(scanJobDataName(job->id, "partial").c_str());
+    shm_unlink(scanJobDataName(job->id, "result").c_str());
+    job->state = SCAN_JOB_FREE;
+}
+
+static void setScanJobStatus(const scanJobSlot *job, RPCMsg *response) {
+    response->set_word("jobId", job->id);
+    response->set_word("state", job->state);
+    response->set_string("scanMethod", job->method);
+    response->set_word("progress", job->progressPpm);
+    response->set_word("dacVal", job->dacVal);
+    response->set_word("channel", job->channel);
+    response->set_word("partialWords", job->partialWords);
+    time_t end = (job->state == SCAN_JOB_QUEUED || job->state == SCAN_JOB_RUNNING) ? time(NULL) : job->endTime;
+    response->set_word("elapsedTime", job->startTime ? difftime(end, job->startTime) : 0);
+    if (job->state == SCAN_JOB_FAILED) response->set_string("error", job->error);
+}
+
+typedef void (*scanMethod)(const RPCMsg *, RPCMsg *);
+
+static const std::map<std::string, scanMethod> scanMethods = {
+    {"checkSbitMappingWithCalPulse", checkSbitMappingWithCalPulse},
+    {"checkSbitRateWithCalPulse", checkSbitRateWithCalPulse},
+    {"dacScan", dacScan},
+    {"dacScanMultiLink", dacScanMultiLink},
+    {"genChannelScan", genChannelScan},
+    {"genScan", genScan},
+    {"genScanMultiLink", genScanMultiLink},
+    {"sbitRateScan", sbitRateScan}
+};
+
+/*! \brief Writes the final state of the job of this worker. The table lock is held, so that cancelScanJob sees the job either running or finished */
+static void finishScanJob(scanJobSlot *job, uint32_t state, const std::string & error) {
+    RPCMsg lockResponse;
+    scanJobsGuard jobs(&lockResponse);
+    if (jobs.table == NULL) LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to lock the scan job table to finish scan job %u", job->id));
+    snprintf(job->error, sizeof(job->error), "%s", error.c_str());
+    if (state == SCAN_JOB_DONE) job->progressPpm = 1000000;
+    job->endTime = time(NULL);
+    job->state = state;
+}
+
+static void runScanJob(scanJobSlot *job, const RPCMsg *request, scanMethod method) {
+    currentJob = job;
+
+    //Wait for the previous jobs and the synchronous scans
+    RPCMsg lockResponse;
+    scanHardwareGuard hardware(&lockResponse, true);
+    if (!hardware.locked()) {
+        finishScanJob(job, job->cancelRequested ? SCAN_JOB_CANCELLED : SCAN_JOB_FAILED, lockResponse.get_string("error"));
+        return;
+    }
+    job->startTime = time(NULL);
+    job->state = SCAN_JOB_RUNNING;
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Running scan job %u: %s", job->id, job->method));
+
+    RPCMsg response(request->get_method());
+    method(request, &response);
+
+    std::string result = response.serialize();
+    bool stored = writeScanJobData(job->id, "result", result.data(), result.size());
+    std::string error;
+    if (response.get_key_exists("error")) {
+        error = response.get_string("error");
+    } else if (!stored) {
+        error = stdsprintf("Unable to store the results: %s", strerror(errno));
+    }
+    //A job whose scan completed before it saw the cancel request is done
+    uint32_t state = scanJobInterrupted ? SCAN_JOB_CANCELLED : (error.empty() ? SCAN_JOB_DONE : SCAN_JOB_FAILED);
+    finishScanJob(job, state, error);
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Finished scan job %u: %s", job->id, scanJobInterrupted ? "cancelled" : (error.empty() ? "done" : error.c_str())));
+}
+
+void submitScanJob(const RPCMsg *request, RPCMsg *response) {
+    std::string methodName = request->get_key_exists("scanMethod") ? request->get_string("scanMethod") : "";
+    auto itMethod = scanMethods.find(methodName);
+    if (itMethod == scanMethods.end()) {
+        std::string errMsg = "Unknown scanMethod \"" + methodName + "\", possible values are:";
+        for (auto & it : scanMethods) errMsg += " " + it.first;
+        response->set_string("error", errMsg);
+        return;
+    }
+
+    scanJobsGuard jobs(response);
+    if (jobs.table == NULL) return;
+
+    //Take a free slot, or the one of the oldest finished job
+    scanJobSlot *job = NULL;
+    for (int i = 0; i < SCAN_JOB_SLOTS; ++i) {
+        scanJobSlot *slot = &jobs.table->slot[i];
+        if (slot->state == SCAN_JOB_FREE) {
+            job = slot;
+            break;
+        }
+        jobs.find(slot->id, response); //update the state of dead workers
+        if (slot->state == SCAN_JOB_QUEUED || slot->state == SCAN_JOB_RUNNING) continue;
+        //Only expired results are dropped, the others are kept until the client fetches them
+        if (time(NULL) - slot->endTime < SCAN_JOB_EXPIRY_S) continue;
+        if (job == NULL || slot->endTime < job->endTime) job = slot;
+    }
+    if (job == NULL) {
+        response->set_string("error", stdsprintf("Too many scan jobs, at most %i can be kept: release the finished ones with fetchScanJob and \"release\" or cancel them", SCAN_JOB_SLOTS));
+        return;
+    }
+    if (job->state != SCAN_JOB_FREE) releaseScanJob(job);
+
+    memset(job, 0, sizeof(scanJobSlot));
+    job->id = ++jobs.table->nextId;
+    snprintf(job->method, sizeof(job->method), "%s", methodName.c_str());
+    job->submitTime = time(NULL);
+    job->state = SCAN_JOB_QUEUED;
+
+    pid_t worker = forkDetached(&job->worker);
+    if (worker == 0) {
+        runScanJob(job, request, itMethod->second);
+        _exit(0);
+    }
+    if (worker < 0) {
+        job->state = SCAN_JOB_FREE;
+        response->set_string("error", stdsprintf("Unable to start the scan job worker: %s", strerror(errno)));
+        return;
+    }
+    response->set_word("jobId", job->id);
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Submitted scan job %u: %s, worker %i", job->id, job->method, worker));
+}
+
+void pollScanJob(const RPCMsg *request, RPCMsg *response) {
+    scanJobsGuard jobs(response);
+    scanJobSlot *job = jobs.find(request->get_word("jobId"), response);
+    if (job == NULL) return;
+    setScanJobStatus(job, response);
+}
+
+void fetchScanJob(const RPCMsg *request, RPCMsg *response) {
+    scanJobsGuard jobs(response);
+    scanJobSlot *job = jobs.find(request->get_word("jobId"), response);
+    if (job == NULL) return;
+    setScanJobStatus(job, response);
+
+    std::string data;
+    bool finished = job->state == SCAN_JOB_DONE || job->state == SCAN_JOB_FAILED || job->state == SCAN_JOB_CANCELLED;
+    if (finished && readScanJobData(job->id, "result", data)) {
+        response->set_binarydata("result", data.data(), data.size());
+    } else if (job->partialWords && readScanJobData(job->id, "partial", data)) {
+        setWordArray(request, response, "partialData", (const uint32_t *)data.data(), data.size()/sizeof(uint32_t));
+    }
+
+    if (finished && request->get_key_exists("release") && request->get_word("release")) releaseScanJob(job);
+}
+
+void cancelScanJob(const RPCMsg *request, RPCMsg *response) {
+    scanJobsGuard jobs(response);
+    scanJobSlot *job = jobs.find(request->get_word("jobId"), response);
+    if (job == NULL) return;
+    //A finished job keeps its state and results
+    if (job->state != SCAN_JOB_QUEUED && job->state != SCAN_JOB_RUNNING) {
+        setScanJobStatus(job, response);
+        return;
+    }
+
+    //The scan stops at its next loop step and restores the hardware as at the end of a scan
+    if (!job->cancelRequested) {
+        job->cancelTime = time(NULL);
+        job->cancelRequested = 1;
+        LOGGER->log_message(LogManager::INFO, stdsprintf("Requested the cancellation of scan job %u", job->id));
+        setScanJobStatus(job, response);
+        return;
+    }
+    if (difftime(time(NULL), job->cancelTime) < SCAN_JOB_CANCEL_GRACE_S) {
+        setScanJobStatus(job, response);
+        return;
+    }
+
+    //Last resort for a worker which did not stop by itself: the hardware is left in the state the scan had reached.
+    //SIGTERM makes the worker release the memhub locks it holds before exiting, SIGKILL if it does not exit within 1 s
+    LOGGER->log_message(LogManager::WARNING, stdsprintf("Scan job %u did not stop within %i s, terminating worker %i", job->id, SCAN_JOB_CANCEL_GRACE_S, job->worker));
+    const int signals[2] = {SIGTERM, SIGKILL};
+    bool exited = false;
+    for (int s = 0; s < 2 && !exited; ++s) {
+        kill(job->worker, signals[s]);
+        for (int i = 0; i < 1000 && !exited; ++i) {
+            exited = kill(job->worker, 0) != 0 && errno == ESRCH;
+            if (!exited) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    if (!exited) {
+        response->set_string("error", stdsprintf("The worker %i of scan job %u did not exit", job->worker, job->id));
+        LOGGER->log_message(LogManager::ERROR, stdsprintf("The worker %i of scan job %u did not exit", job->worker, job->id));
+        return;
+    }
+    job->endTime = time(NULL);
+    job->state = SCAN_JOB_CANCELLED;
+    setScanJobStatus(job, response);
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Terminated scan job %u", job->id));
+}
+
 extern "C" {
     const char *module_version_key = "calibration_routines v1.0.1";
     int module_activity_color = 4;
@@ -1375,14 +2094,20 @@ extern "C" {
             LOGGER->log_message(LogManager::ERROR, "Unable to load module");
             return; // Do not register our functions, we depend on memsvc.
         }
+        openAddressTable();
         modmgr->register_method("calibration_routines", "checkSbitMappingWithCalPulse", checkSbitMappingWithCalPulse);
         modmgr->register_method("calibration_routines", "checkSbitRateWithCalPulse", checkSbitRateWithCalPulse);
         modmgr->register_method("calibration_routines", "dacScan", dacScan);
         modmgr->register_method("calibration_routines", "dacScanMultiLink", dacScanMultiLink);
         modmgr->register_method("calibration_routines", "genScan", genScan);
+        modmgr->register_method("calibration_routines", "genScanMultiLink", genScanMultiLink);
         modmgr->register_method("calibration_routines", "genChannelScan", genChannelScan);
         modmgr->register_method("calibration_routines", "sbitRateScan", sbitRateScan);
         modmgr->register_method("calibration_routines", "ttcGenConf", ttcGenConf);
         modmgr->register_method("calibration_routines", "ttcGenToggle", ttcGenToggle);
+        modmgr->register_method("calibration_routines", "submitScanJob", submitScanJob);
+        modmgr->register_method("calibration_routines", "pollScanJob", pollScanJob);
+        modmgr->register_method("calibration_routines", "fetchScanJob", fetchScanJob);
+        modmgr->register_method("calibration_routines", "cancelScanJob", cancelScanJob);
     }
 }
@@ -12,31 +12,27 @@
 void getmonTTCmainLocal(localArgs * la)
 {
   LOGGER->log_message(LogManager::INFO, "Called getmonTTCmainLocal");
-  la->response->set_word("MMCM_LOCKED",readReg(la,"GEM_AMC.TTC.STATUS.CLK.MMCM_LOCKED"));
-  la->response->set_word("TTC_SINGLE_ERROR_CNT",readReg(la,"GEM_AMC.TTC.STATUS.TTC_SINGLE_ERROR_CNT"));
-  la->response->set_word("BC0_LOCKED",readReg(la,"GEM_AMC.TTC.STATUS.BC0.LOCKED"));
-  la->response->set_word("L1A_ID",readReg(la,"GEM_AMC.TTC.L1A_ID"));
-  la->response->set_word("L1A_RATE",readReg(la,"GEM_AMC.TTC.L1A_RATE"));
+  regBatch batch;
+  batch.read(la, "GEM_AMC.TTC.STATUS.CLK.MMCM_LOCKED", "MMCM_LOCKED");
+  batch.read(la, "GEM_AMC.TTC.STATUS.TTC_SINGLE_ERROR_CNT", "TTC_SINGLE_ERROR_CNT");
+  batch.read(la, "GEM_AMC.TTC.STATUS.BC0.LOCKED", "BC0_LOCKED");
+  batch.read(la, "GEM_AMC.TTC.L1A_ID", "L1A_ID");
+  batch.read(la, "GEM_AMC.TTC.L1A_RATE", "L1A_RATE");
+  batch.execute(la);
 }
 
 void getmonTTCmain(const RPCMsg *request, RPCMsg *response)
 {
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+  addressTableTxn atxn;
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
   getmonTTCmainLocal(&la);
-  rtxn.abort();
 }
 
 void getmonTRIGGERmainLocal(localArgs * la, int NOH, int ohMask)
 {
   std::string t1,t2;
-  la->response->set_word("OR_TRIGGER_RATE",readReg(la,"GEM_AMC.TRIGGER.STATUS.OR_TRIGGER_RATE"));
+  regBatch batch;
+  batch.read(la, "GEM_AMC.TRIGGER.STATUS.OR_TRIGGER_RATE", "OR_TRIGGER_RATE");
   for (int ohN = 0; ohN < NOH; ohN++){
     // If this Optohybrid is masked fill with 0xdeaddead
     if(!((ohMask >> ohN) & 0x1)){
@@ -46,22 +42,17 @@ void getmonTRIGGERmainLocal(localArgs * la, int NOH, int ohMask)
     }
     t1 = stdsprintf("OH%s.TRIGGER_RATE",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.TRIGGER.OH%s.TRIGGER_RATE",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
   }
+  batch.execute(la);
 }
 
 void getmonTRIGGERmain(const RPCMsg *request, RPCMsg *response)
 {
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
-
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  addressTableTxn atxn;
+
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
+  unsigned int NOH = getFwCapabilities(&la).numOfOH;
   int ohMask = 0xfff;
   if(request->get_key_exists("ohMask")){
     ohMask = request->get_word("ohMask");
@@ -77,12 +68,12 @@ void getmonTRIGGERmain(const RPCMsg *request, RPCMsg *response)
   }
   
   getmonTRIGGERmainLocal(&la, NOH, ohMask);
-  rtxn.abort();
 }
 
 void getmonTRIGGEROHmainLocal(localArgs * la, int NOH, int ohMask)
 {
   std::string t1,t2;
+  regBatch batch;
   for (int ohN = 0; ohN < NOH; ohN++){
     // If this Optohybrid is masked skip it
     if(!((ohMask >> ohN) & 0x1)){
@@ -106,43 +97,38 @@ void getmonTRIGGEROHmainLocal(localArgs * la, int NOH, int ohMask)
     }
     t1 = stdsprintf("OH%s.LINK0_MISSED_COMMA_CNT",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.TRIGGER.OH%s.LINK0_MISSED_COMMA_CNT",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.LINK1_MISSED_COMMA_CNT",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.TRIGGER.OH%s.LINK1_MISSED_COMMA_CNT",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.LINK0_OVERFLOW_CNT",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.TRIGGER.OH%s.LINK0_OVERFLOW_CNT",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.LINK1_OVERFLOW_CNT",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.TRIGGER.OH%s.LINK1_OVERFLOW_CNT",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.LINK0_UNDERFLOW_CNT",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.TRIGGER.OH%s.LINK0_UNDERFLOW_CNT",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.LINK1_UNDERFLOW_CNT",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.TRIGGER.OH%s.LINK1_UNDERFLOW_CNT",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.LINK0_SBIT_OVERFLOW_CNT",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.TRIGGER.OH%s.LINK0_SBIT_OVERFLOW_CNT",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.LINK1_SBIT_OVERFLOW_CNT",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.TRIGGER.OH%s.LINK1_SBIT_OVERFLOW_CNT",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
   }
+  batch.execute(la);
 }
 
 void getmonTRIGGEROHmain(const RPCMsg *request, RPCMsg *response)
 {
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
-
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};  
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  addressTableTxn atxn;
+
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};  
+  unsigned int NOH = getFwCapabilities(&la).numOfOH;
   int ohMask = 0xfff;
   if(request->get_key_exists("ohMask")){
     ohMask = request->get_word("ohMask");
@@ -158,41 +144,36 @@ void getmonTRIGGEROHmain(const RPCMsg *request, RPCMsg *response)
   }
 
   getmonTRIGGEROHmainLocal(&la, NOH, ohMask);
-  rtxn.abort();
 }
 
 void getmonDAQmainLocal(localArgs * la)
 {
-  la->response->set_word("DAQ_ENABLE",readReg(la,"GEM_AMC.DAQ.CONTROL.DAQ_ENABLE"));
-  la->response->set_word("DAQ_LINK_READY",readReg(la,"GEM_AMC.DAQ.STATUS.DAQ_LINK_RDY"));
-  la->response->set_word("DAQ_LINK_AFULL",readReg(la,"GEM_AMC.DAQ.STATUS.DAQ_LINK_AFULL"));
-  la->response->set_word("DAQ_OFIFO_HAD_OFLOW",readReg(la,"GEM_AMC.DAQ.STATUS.DAQ_OUTPUT_FIFO_HAD_OVERFLOW"));
-  la->response->set_word("L1A_FIFO_HAD_OFLOW",readReg(la,"GEM_AMC.DAQ.STATUS.L1A_FIFO_HAD_OVERFLOW"));
-  la->response->set_word("L1A_FIFO_DATA_COUNT",readReg(la,"GEM_AMC.DAQ.EXT_STATUS.L1A_FIFO_DATA_CNT"));
-  la->response->set_word("DAQ_FIFO_DATA_COUNT",readReg(la,"GEM_AMC.DAQ.EXT_STATUS.DAQ_FIFO_DATA_CNT"));
-  la->response->set_word("EVENT_SENT",readReg(la,"GEM_AMC.DAQ.EXT_STATUS.EVT_SENT"));
-  la->response->set_word("TTS_STATE",readReg(la,"GEM_AMC.DAQ.STATUS.TTS_STATE"));
-  la->response->set_word("INPUT_ENABLE_MASK",readReg(la,"GEM_AMC.DAQ.CONTROL.INPUT_ENABLE_MASK"));
-  la->response->set_word("INPUT_AUTOKILL_MASK",readReg(la,"GEM_AMC.DAQ.STATUS.INPUT_AUTOKILL_MASK"));
+  regBatch batch;
+  batch.read(la, "GEM_AMC.DAQ.CONTROL.DAQ_ENABLE", "DAQ_ENABLE");
+  batch.read(la, "GEM_AMC.DAQ.STATUS.DAQ_LINK_RDY", "DAQ_LINK_READY");
+  batch.read(la, "GEM_AMC.DAQ.STATUS.DAQ_LINK_AFULL", "DAQ_LINK_AFULL");
+  batch.read(la, "GEM_AMC.DAQ.STATUS.DAQ_OUTPUT_FIFO_HAD_OVERFLOW", "DAQ_OFIFO_HAD_OFLOW");
+  batch.read(la, "GEM_AMC.DAQ.STATUS.L1A_FIFO_HAD_OVERFLOW", "L1A_FIFO_HAD_OFLOW");
+  batch.read(la, "GEM_AMC.DAQ.EXT_STATUS.L1A_FIFO_DATA_CNT", "L1A_FIFO_DATA_COUNT");
+  batch.read(la, "GEM_AMC.DAQ.EXT_STATUS.DAQ_FIFO_DATA_CNT", "DAQ_FIFO_DATA_COUNT");
+  batch.read(la, "GEM_AMC.DAQ.EXT_STATUS.EVT_SENT", "EVENT_SENT");
+  batch.read(la, "GEM_AMC.DAQ.STATUS.TTS_STATE", "TTS_STATE");
+  batch.read(la, "GEM_AMC.DAQ.CONTROL.INPUT_ENABLE_MASK", "INPUT_ENABLE_MASK");
+  batch.read(la, "GEM_AMC.DAQ.STATUS.INPUT_AUTOKILL_MASK", "INPUT_AUTOKILL_MASK");
+  batch.execute(la);
 }
 
 void getmonDAQmain(const RPCMsg *request, RPCMsg *response)
 {
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+  addressTableTxn atxn;
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
   getmonDAQmainLocal(&la);
-  rtxn.abort();
 }
 
 void getmonDAQOHmainLocal(localArgs * la, int NOH, int ohMask)
 {
   std::string t1,t2;
+  regBatch batch;
   for (int ohN = 0; ohN < NOH; ohN++){
     // If this Optohybrid is masked skip it
     if(!((ohMask >> ohN) & 0x1)){
@@ -212,37 +193,32 @@ void getmonDAQOHmainLocal(localArgs * la, int NOH, int ohMask)
     }
     t1 = stdsprintf("OH%s.STATUS.EVT_SIZE_ERR",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.DAQ.%s",t1.c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.STATUS.EVENT_FIFO_HAD_OFLOW",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.DAQ.%s",t1.c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.STATUS.INPUT_FIFO_HAD_OFLOW",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.DAQ.%s",t1.c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.STATUS.INPUT_FIFO_HAD_UFLOW",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.DAQ.%s",t1.c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.STATUS.VFAT_TOO_MANY",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.DAQ.%s",t1.c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.STATUS.VFAT_NO_MARKER",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.DAQ.%s",t1.c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
   }
+  batch.execute(la);
 }
 
 void getmonDAQOHmain(const RPCMsg *request, RPCMsg *response)
 {
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
-
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};  
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  addressTableTxn atxn;
+
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};  
+  unsigned int NOH = getFwCapabilities(&la).numOfOH;
   int ohMask = 0xfff;
   if(request->get_key_exists("ohMask")){
     ohMask = request->get_word("ohMask");
@@ -258,12 +234,14 @@ void getmonDAQOHmain(const RPCMsg *request, RPCMsg *response)
   }
 
   getmonDAQOHmainLocal(&la, NOH, ohMask);
-  rtxn.abort();
 }
 
 void getmonOHmainLocal(localArgs * la, int NOH, int ohMask)
 {
   std::string t1,t2;
+  regBatch batch;
+  bool isV3 = (fw_version_check("getmonOHmain",la) == 3);
+  std::vector<std::pair<int, size_t> > fwverIdx; //OH number and batch index of the VERSION.MAJOR read
   for (int ohN = 0; ohN < NOH; ohN++){
     // If this Optohybrid is masked skip it
     if(!((ohMask >> ohN) & 0x1)){
@@ -288,65 +266,60 @@ void getmonOHmainLocal(localArgs * la, int NOH, int ohMask)
       continue;
     }
     t1 = stdsprintf("OH%s.FW_VERSION",std::to_string(ohN).c_str());
-    if (fw_version_check("getmonOHmain",la) == 3) 
+    if (isV3)
     {
-      uint32_t t_fwver=0xffffffff;
-      t2 = stdsprintf("GEM_AMC.OH.OH%s.FPGA.CONTROL.RELEASE.VERSION.MAJOR",std::to_string(ohN).c_str());
-      t_fwver = t_fwver & (0x00ffffff|(readReg(la,t2) << 24));
-      LOGGER->log_message(LogManager::INFO, stdsprintf("FW version MAJOR for OH%i is %08x, t_fwver is %08x ",ohN, readReg(la,t2), t_fwver));
-      t2 = stdsprintf("GEM_AMC.OH.OH%s.FPGA.CONTROL.RELEASE.VERSION.MINOR",std::to_string(ohN).c_str());
-      t_fwver = t_fwver & (0xff00ffff|(readReg(la,t2) << 16));
-      LOGGER->log_message(LogManager::INFO, stdsprintf("FW version MINOR for OH%i is %08x, t_fwver is %08x ",ohN, readReg(la,t2), t_fwver));
-      t2 = stdsprintf("GEM_AMC.OH.OH%s.FPGA.CONTROL.RELEASE.VERSION.BUILD",std::to_string(ohN).c_str());
-      t_fwver = t_fwver & (0xffff00ff|(readReg(la,t2) << 8));
-      LOGGER->log_message(LogManager::INFO, stdsprintf("FW version BUILD for OH%i is %08x, t_fwver is %08x ",ohN, readReg(la,t2), t_fwver));
-      t2 = stdsprintf("GEM_AMC.OH.OH%s.FPGA.CONTROL.RELEASE.VERSION.GENERATION",std::to_string(ohN).c_str());
-      t_fwver = t_fwver & (0xffffff00|(readReg(la,t2)));
-      LOGGER->log_message(LogManager::INFO, stdsprintf("FW version GENERATION for OH%i is %08x, t_fwver is %08x ",ohN, readReg(la,t2), t_fwver));
-      la->response->set_word(t1,t_fwver);
+      t2 = stdsprintf("GEM_AMC.OH.OH%s.FPGA.CONTROL.RELEASE.VERSION.",std::to_string(ohN).c_str());
+      fwverIdx.push_back(std::make_pair(ohN, batch.read(la,t2+"MAJOR")));
+      batch.read(la,t2+"MINOR");
+      batch.read(la,t2+"BUILD");
+      batch.read(la,t2+"GENERATION");
     } else {
       t2 = stdsprintf("GEM_AMC.OH.OH%s.STATUS.FW.VERSION",std::to_string(ohN).c_str());
-      la->response->set_word(t1,readReg(la,t2));
+      batch.read(la, t2, t1);
     }
     t1 = stdsprintf("OH%s.EVENT_COUNTER",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.DAQ.OH%s.COUNTERS.EVN",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.EVENT_RATE",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.DAQ.OH%s.COUNTERS.EVT_RATE",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.GTX.TRK_ERR",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.OH.OH%s.COUNTERS.GTX_LINK.TRK_ERR",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.GTX.TRG_ERR",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.OH.OH%s.COUNTERS.GTX_LINK.TRG_ERR",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.GBT.TRK_ERR",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.OH.OH%s.COUNTERS.GBT_LINK.TRK_ERR",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.CORR_VFAT_BLK_CNT",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.DAQ.OH%s.COUNTERS.CORRUPT_VFAT_BLK_CNT",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.COUNTERS.SEU",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.OH.OH%s.COUNTERS.SEU",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
     t1 = stdsprintf("OH%s.STATUS.SEU",std::to_string(ohN).c_str());
     t2 = stdsprintf("GEM_AMC.OH.OH%s.STATUS.SEU",std::to_string(ohN).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
+  }
+  batch.execute(la);
+  for (auto & fwver : fwverIdx) {
+    uint32_t t_fwver=0xffffffff;
+    t_fwver = t_fwver & (0x00ffffff|(batch.result(fwver.second) << 24));
+    t_fwver = t_fwver & (0xff00ffff|(batch.result(fwver.second+1) << 16));
+    t_fwver = t_fwver & (0xffff00ff|(batch.result(fwver.second+2) << 8));
+    t_fwver = t_fwver & (0xffffff00|(batch.result(fwver.second+3)));
+    LOGGER->log_message(LogManager::INFO, stdsprintf("FW version for OH%i is %08x",fwver.first, t_fwver));
+    la->response->set_word(stdsprintf("OH%s.FW_VERSION",std::to_string(fwver.first).c_str()),t_fwver);
   }
 }
 
 void getmonOHmain(const RPCMsg *request, RPCMsg *response)
 {
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
-
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};  
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  addressTableTxn atxn;
+
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};  
+  unsigned int NOH = getFwCapabilities(&la).numOfOH;
   int ohMask = 0xfff;
   if(request->get_key_exists("ohMask")){
     ohMask = request->get_word("ohMask");
@@ -362,7 +335,6 @@ void getmonOHmain(const RPCMsg *request, RPCMsg *response)
   }
  
   getmonOHmainLocal(&la, NOH, ohMask);
-  rtxn.abort();
 }
 
 void getmonOHSCAmainLocal(localArgs *la, int NOH, int ohMask){
@@ -371,8 +343,9 @@ void getmonOHSCAmainLocal(localArgs *la, int NOH, int ohMask){
     //Get original monitoring mask
     uint32_t initSCAMonOffMask = readReg(la, "GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.MONITORING_OFF");
 
-    //Turn on monitoring for requested links
-    writeReg(la, "GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.MONITORING_OFF", (~ohMask) & 0x3fc);
+    //Turn on monitoring for requested links, all the values are then read with a single memhub lock acquisition
+    regBatch batch;
+    batch.write(la, "GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.MONITORING_OFF", (~ohMask) & 0x3fc);
 
     for (int ohN = 0; ohN < NOH; ++ohN){ //Loop over all optohybrids
         // If this Optohybrid is masked skip it
@@ -424,65 +397,66 @@ void getmonOHSCAmainLocal(localArgs *la, int NOH, int ohMask){
         //SCA Temperature
         strRegName = stdsprintf("GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.OH%i.SCA_TEMP",ohN);
         strKeyName = stdsprintf("OH%i.SCA_TEMP",ohN);
-        la->response->set_word(strKeyName,readReg(la, strRegName));
+        batch.read(la, strRegName, strKeyName);
 
         //OH Temperature Sensors
         for(int tempVal=1; tempVal <= 9; ++tempVal){ //Loop over optohybrid temperatures sensosrs
             strRegName = stdsprintf("GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.OH%i.BOARD_TEMP%i",ohN,tempVal);
             strKeyName = stdsprintf("OH%i.BOARD_TEMP%i",ohN,tempVal);
-            la->response->set_word(strKeyName, readReg(la, strRegName));
+            batch.read(la, strRegName, strKeyName);
         } //End Loop over optohybrid temeprature sensors
 
         //Voltage Monitor - AVCCN
         strRegName = stdsprintf("GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.OH%i.AVCCN",ohN);
         strKeyName = stdsprintf("OH%i.AVCCN",ohN);
-        la->response->set_word(strKeyName, readReg(la, strRegName));
+        batch.read(la, strRegName, strKeyName);
 
         //Voltage Monitor - AVTTN
         strRegName = stdsprintf("GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.OH%i.AVTTN",ohN);
         strKeyName = stdsprintf("OH%i.AVTTN",ohN);
-        la->response->set_word(strKeyName, readReg(la, strRegName));
+        batch.read(la, strRegName, strKeyName);
 
         //Voltage Monitor - 1V0_INT
         strRegName = stdsprintf("GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.OH%i.1V0_INT",ohN);
         strKeyName = stdsprintf("OH%i.1V0_INT",ohN);
-        la->response->set_word(strKeyName, readReg(la, strRegName));
+        batch.read(la, strRegName, strKeyName);
 
         //Voltage Monitor - 1V8F
         strRegName = stdsprintf("GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.OH%i.1V8F",ohN);
         strKeyName = stdsprintf("OH%i.1V8F",ohN);
-        la->response->set_word(strKeyName, readReg(la, strRegName));
+        batch.read(la, strRegName, strKeyName);
 
         //Voltage Monitor - 1V5
         strRegName = stdsprintf("GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.OH%i.1V5",ohN);
         strKeyName = stdsprintf("OH%i.1V5",ohN);
-        la->response->set_word(strKeyName, readReg(la, strRegName));
+        batch.read(la, strRegName, strKeyName);
 
         //Voltage Monitor - 2V5_IO
         strRegName = stdsprintf("GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.OH%i.2V5_IO",ohN);
         strKeyName = stdsprintf("OH%i.2V5_IO",ohN);
-        la->response->set_word(strKeyName, readReg(la, strRegName));
+        batch.read(la, strRegName, strKeyName);
 
         //Voltage Monitor - 3V0
         strRegName = stdsprintf("GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.OH%i.3V0",ohN);
         strKeyName = stdsprintf("OH%i.3V0",ohN);
-        la->response->set_word(strKeyName, readReg(la, strRegName));
+        batch.read(la, strRegName, strKeyName);
 
         //Voltage Monitor - 1V8
         strRegName = stdsprintf("GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.OH%i.1V8",ohN);
         strKeyName = stdsprintf("OH%i.1V8",ohN);
-        la->response->set_word(strKeyName, readReg(la, strRegName));
+        batch.read(la, strRegName, strKeyName);
 
         //Voltage Monitor - VTRX_RSSI2
         strRegName = stdsprintf("GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.OH%i.VTRX_RSSI2",ohN);
         strKeyName = stdsprintf("OH%i.VTRX_RSSI2",ohN);
-        la->response->set_word(strKeyName, readReg(la, strRegName));
+        batch.read(la, strRegName, strKeyName);
 
         //Voltage Monitor - VTRX_RSSI1
         strRegName = stdsprintf("GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.OH%i.VTRX_RSSI1",ohN);
         strKeyName = stdsprintf("OH%i.VTRX_RSSI1",ohN);
-        la->response->set_word(strKeyName, readReg(la, strRegName));
+        batch.read(la, strRegName, strKeyName);
     } //End Loop over all optohybrids
+    batch.execute(la);
 
     //Return monitoring to original value
     writeReg(la, "GEM_AMC.SLOW_CONTROL.SCA.ADC_MONITORING.MONITORING_OFF", initSCAMonOffMask);
@@ -492,16 +466,10 @@ void getmonOHSCAmainLocal(localArgs *la, int NOH, int ohMask){
 
 void getmonOHSCAmain(const RPCMsg *request, RPCMsg *response)
 {
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
-
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};  
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  addressTableTxn atxn;
+
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};  
+  unsigned int NOH = getFwCapabilities(&la).numOfOH;
   int ohMask = 0xfff;
   if(request->get_key_exists("ohMask")){
     ohMask = request->get_word("ohMask");
@@ -517,12 +485,13 @@ void getmonOHSCAmain(const RPCMsg *request, RPCMsg *response)
   }
  
   getmonOHSCAmainLocal(&la, NOH, ohMask);
-  rtxn.abort();
 }
 
 void getmonOHSysmonLocal(localArgs *la, int NOH, int ohMask, bool doReset){
     std::string strKeyName;
     std::string strRegBase;
+    regBatch batch;
+    std::vector<std::pair<std::string, size_t> > sysmonIdx; //Response key and batch index of the raw sysmon values
 
     if (fw_version_check("getmonOHSysmon", la) == 3){
         for (int ohN = 0; ohN < NOH; ++ohN){ //Loop over all optohybrids
@@ -564,50 +533,50 @@ void getmonOHSysmonLocal(localArgs *la, int NOH, int ohMask, bool doReset){
             //Issue reset??
             if(doReset){
                 LOGGER->log_message(LogManager::INFO, stdsprintf("Reseting CNT_OVERTEMP, CNT_VCCAUX_ALARM and CNT_VCCINT_ALARM for OH%i",ohN));
-                writeReg(la, strRegBase+"RESET", 0x1);
+                batch.write(la, strRegBase+"RESET", 0x1);
             }
 
             //Read Alarm conditions & counters - OVERTEMP
             strKeyName = stdsprintf("OH%i.OVERTEMP",ohN);
-            la->response->set_word(strKeyName,readReg(la, strRegBase + "OVERTEMP"));
+            batch.read(la, strRegBase + "OVERTEMP", strKeyName);
 
             strKeyName = stdsprintf("OH%i.CNT_OVERTEMP",ohN);
-            la->response->set_word(strKeyName,readReg(la, strRegBase + "CNT_OVERTEMP"));
+            batch.read(la, strRegBase + "CNT_OVERTEMP", strKeyName);
 
             //Read Alarm conditions & counters - VCCAUX_ALARM
             strKeyName = stdsprintf("OH%i.VCCAUX_ALARM",ohN);
-            la->response->set_word(strKeyName,readReg(la, strRegBase + "VCCAUX_ALARM"));
+            batch.read(la, strRegBase + "VCCAUX_ALARM", strKeyName);
 
             strKeyName = stdsprintf("OH%i.CNT_VCCAUX_ALARM",ohN);
-            la->response->set_word(strKeyName,readReg(la, strRegBase + "CNT_VCCAUX_ALARM"));
+            batch.read(la, strRegBase + "CNT_VCCAUX_ALARM", strKeyName);
 
             //Read Alarm conditions & counters - VCCINT_ALARM
             strKeyName = stdsprintf("OH%i.VCCINT_ALARM",ohN);
-            la->response->set_word(strKeyName,readReg(la, strRegBase + "VCCINT_ALARM"));
+            batch.read(la, strRegBase + "VCCINT_ALARM", strKeyName);
 
             strKeyName = stdsprintf("OH%i.CNT_VCCINT_ALARM",ohN);
-            la->response->set_word(strKeyName,readReg(la, strRegBase + "CNT_VCCINT_ALARM"));
+            batch.read(la, strRegBase + "CNT_VCCINT_ALARM", strKeyName);
 
             //Enable Sysmon ADC Read
-            writeReg(la, strRegBase + "ENABLE", 0x1);
+            batch.write(la, strRegBase + "ENABLE", 0x1);
 
             //Read Sysmon Values - Core Temperature
-            writeReg(la, strRegBase + "ADR_IN", 0x0);
+            batch.write(la, strRegBase + "ADR_IN", 0x0);
             strKeyName = stdsprintf("OH%i.FPGA_CORE_TEMP",ohN);
-            la->response->set_word(strKeyName, ((readReg(la, strRegBase + "DATA_OUT") >> 6) & 0x3ff));
+            sysmonIdx.push_back(std::make_pair(strKeyName, batch.read(la, strRegBase + "DATA_OUT")));
 
             //Read Sysmon Values - Core Voltage
-            writeReg(la, strRegBase + "ADR_IN", 0x1);
+            batch.write(la, strRegBase + "ADR_IN", 0x1);
             strKeyName = stdsprintf("OH%i.FPGA_CORE_1V0",ohN);
-            la->response->set_word(strKeyName, ((readReg(la, strRegBase + "DATA_OUT") >> 6) & 0x3ff));
+            sysmonIdx.push_back(std::make_pair(strKeyName, batch.read(la, strRegBase + "DATA_OUT")));
 
             //Read Sysmon Values - I/O Voltage
-            writeReg(la, strRegBase + "ADR_IN", 0x2);
+            batch.write(la, strRegBase + "ADR_IN", 0x2);
             strKeyName = stdsprintf("OH%i.FPGA_CORE_2V5_IO",ohN);
-            la->response->set_word(strKeyName, ((readReg(la, strRegBase + "DATA_OUT") >> 6) & 0x3ff));
+            sysmonIdx.push_back(std::make_pair(strKeyName, batch.read(la, strRegBase + "DATA_OUT")));
 
             //Disable Sysmon ADC Read
-            writeReg(la, strRegBase + "ENABLE", 0x0);
+            batch.write(la, strRegBase + "ENABLE", 0x0);
         } //End Loop over all optohybrids
     } //End Case: v3 Electronics
     else{ //Case: v2b Electronics
@@ -634,32 +603,31 @@ void getmonOHSysmonLocal(localArgs *la, int NOH, int ohMask, bool doReset){
 
             //Read Sysmon Values - Core Temperature
             strKeyName = stdsprintf("OH%i.FPGA_CORE_TEMP",ohN);
-            la->response->set_word(strKeyName, ((readReg(la, strRegBase + "TEMP") >> 6) & 0x3ff));
+            sysmonIdx.push_back(std::make_pair(strKeyName, batch.read(la, strRegBase + "TEMP")));
 
             //Read Sysmon Values - Core Voltage
             strKeyName = stdsprintf("OH%i.FPGA_CORE_1V0",ohN);
-            la->response->set_word(strKeyName, ((readReg(la, strRegBase + "VCCINT") >> 6) & 0x3ff));
+            sysmonIdx.push_back(std::make_pair(strKeyName, batch.read(la, strRegBase + "VCCINT")));
 
             //Read Sysmon Values - I/O Voltage
             strKeyName = stdsprintf("OH%i.FPGA_CORE_2V5_IO",ohN);
-            la->response->set_word(strKeyName, ((readReg(la, strRegBase + "VCCAUX") >> 6) & 0x3ff));
+            sysmonIdx.push_back(std::make_pair(strKeyName, batch.read(la, strRegBase + "VCCAUX")));
         } //End Loop all optohybrids
     } //End Case: v2b Electronics
 
+    batch.execute(la);
+    for (auto & sysmon : sysmonIdx) {
+        la->response->set_word(sysmon.first, ((batch.result(sysmon.second) >> 6) & 0x3ff));
+    }
+
     return;
 } //End getmonOHSysmonLocal()
 
 void getmonOHSysmon(const RPCMsg *request, RPCMsg *response){
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
-
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};  
-  unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+  addressTableTxn atxn;
+
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};  
+  unsigned int NOH = getFwCapabilities(&la).numOfOH;
   int ohMask = 0xfff;
   if(request->get_key_exists("ohMask")){
     ohMask = request->get_word("ohMask");
@@ -677,34 +645,28 @@ void getmonOHSysmon(const RPCMsg *request, RPCMsg *response){
   bool doReset = request->get_word("doReset");
 
   getmonOHSysmonLocal(&la, NOH, ohMask, doReset);
-  rtxn.abort();
 } //End getmonOHSysmon()
 
 void getmonSCALocal(localArgs * la, int NOH)
 {
   std::string t1,t2;
-  la->response->set_word("SCA.STATUS.READY", readReg(la, "GEM_AMC.SLOW_CONTROL.SCA.STATUS.READY"));
-  la->response->set_word("SCA.STATUS.CRITICAL_ERROR", readReg(la, "GEM_AMC.SLOW_CONTROL.SCA.STATUS.CRITICAL_ERROR"));
+  regBatch batch;
+  batch.read(la, "GEM_AMC.SLOW_CONTROL.SCA.STATUS.READY", "SCA.STATUS.READY");
+  batch.read(la, "GEM_AMC.SLOW_CONTROL.SCA.STATUS.CRITICAL_ERROR", "SCA.STATUS.CRITICAL_ERROR");
   for (int i = 0; i < NOH; ++i) {
     t1 = stdsprintf("SCA.STATUS.NOT_READY_CNT_OH%s",std::to_string(i).c_str());
     t2 = stdsprintf("GEM_AMC.SLOW_CONTROL.SCA.STATUS.NOT_READY_CNT_OH%s",std::to_string(i).c_str());
-    la->response->set_word(t1,readReg(la,t2));
+    batch.read(la, t2, t1);
   }
+  batch.execute(la);
 }
 
 void getmonSCA(const RPCMsg *request, RPCMsg *response){
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
+  addressTableTxn atxn;
   int NOH = request->get_word("NOH");
 
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
   getmonSCALocal(&la, NOH);
-  rtxn.abort();
 } //End getmonSCA()
 
 extern "C" {
@@ -716,6 +678,7 @@ extern "C" {
             LOGGER->log_message(LogManager::ERROR, "Unable to load module");
             return; // Do not register our functions, we depend on memsvc.
         }
+        openAddressTable();
         modmgr->register_method("daq_monitor", "getmonTTCmain", getmonTTCmain);
         modmgr->register_method("daq_monitor", "getmonTRIGGERmain", getmonTRIGGERmain);
         modmgr->register_method("daq_monitor", "getmonTRIGGEROHmain", getmonTRIGGEROHmain);
@@ -6,11 +6,13 @@
 #include "moduleapi.h"
 //#include <libmemsvc.h>
 #include "memhub.h"
+#include <algorithm>
+#include <vector>
 
 memsvc_handle_t memsvc; /// \var global memory service handle required for registers read/write operations
 
 /*! \fn void mblockread(const RPCMsg *request, RPCMsg *response)
- *  \brief Sequentially reads a block of values from the same raw register address. Register mask is not applied
+ *  \brief Sequentially reads a block of values from the same raw register address, e.g. a FIFO, without releasing the memhub lock in between. Register mask is not applied
  *  \param request RPC request message
  *  \param response RPC response message
  */
@@ -19,18 +21,22 @@ void mblockread(const RPCMsg *request, RPCMsg *response) {
   uint32_t addr = request->get_word("address");
   uint32_t data[count];
 
-  for (unsigned int i=0; i<count; i++){
-    if (memhub_read(memsvc, addr, 1, &data[i]) != 0) {
-      response->set_string("error", memsvc_get_last_error(memsvc));
-      LOGGER->log_message(LogManager::INFO, stdsprintf("read memsvc error: %s", memsvc_get_last_error(memsvc)));
-      return;
-    }
+  if (memhub_read_fifo(memsvc, addr, count, data) != 0) {
+    response->set_string("error", memsvc_get_last_error(memsvc));
+    LOGGER->log_message(LogManager::INFO, stdsprintf("read memsvc error: %s", memsvc_get_last_error(memsvc)));
+    return;
   }
 	response->set_word_array("data", data, count);
 }
 
 /*! \fn void mlistread(const RPCMsg *request, RPCMsg *response)
- *  \brief Reads a list of raw addresses
+ *  \brief Reads a list of raw addresses.
+ *         Addresses are sorted and contiguous ones are read with a single memsvc call, all under one memhub lock acquisition.
+ *         Values are returned in request order, an address listed several times is read once.
+ *         "status" holds 0 for every address read successfully and 1 otherwise, failed addresses read 0xdeaddead.
+ *         "error" is also set if any address failed.
+ *         If a multi-word read fails, its words are read again one by one to find the failing ones: every word of that run is then read twice,
+ *         so clear-on-read counters and FIFO ports should be read with mblockread or listed apart from their neighbours
  *  \param request RPC request message
  *  \param response RPC response message
  */
@@ -38,17 +44,119 @@ void mlistread(const RPCMsg *request, RPCMsg *response) {
   uint32_t count = request->get_word("count");
   uint32_t addr[count];
   request->get_word_array("addresses", addr);
-  uint32_t data[count];
+  std::vector<uint32_t> data(count, 0xdeaddead);
+  std::vector<uint32_t> status(count, 0);
+
+  std::vector<uint32_t> order(count);
+  for (unsigned int i=0; i<count; i++) order[i] = i;
+  std::sort(order.begin(), order.end(), [&addr](uint32_t a, uint32_t b) { return addr[a] < addr[b]; });
+
+  // sorted unique addresses, split in runs of consecutive words
+  std::vector<uint32_t> words;
+  std::vector<memhub_run> runs;
+  words.reserve(count);
+  for (unsigned int k=0; k<count; k++){
+    uint32_t a = addr[order[k]];
+    if (!words.empty() && words.back() == a) continue;
+    if (runs.empty() || a != runs.back().addr + 4*runs.back().words) {
+      runs.push_back({a, 0, NULL, 0});
+    }
+    ++runs.back().words;
+    words.push_back(a);
+  }
+  std::vector<uint32_t> values(words.size());
+  std::vector<uint32_t> valueStatus(words.size(), 0);
+  size_t offset = 0;
+  for (auto & run : runs) {
+    run.data = &values[offset];
+    offset += run.words;
+  }
+
+  if (memhub_read_runs(memsvc, runs.data(), runs.size(), MEMHUB_DEFAULT_MAX_HOLD_US) != 0) {
+    // find out which words of the failed runs are not readable, a failed single word is not read again
+    offset = 0;
+    for (auto & run : runs) {
+      if (run.status != 0 && run.words == 1) {
+        valueStatus[offset] = 1;
+        LOGGER->log_message(LogManager::INFO, stdsprintf("read memsvc error at %08X: %s", run.addr, memsvc_get_last_error(memsvc)));
+      } else if (run.status != 0) {
+        for (unsigned int w=0; w<run.words; w++){
+          if (memhub_read(memsvc, run.addr + 4*w, 1, &values[offset+w]) != 0) {
+            valueStatus[offset+w] = 1;
+            LOGGER->log_message(LogManager::INFO, stdsprintf("read memsvc error at %08X: %s", run.addr + 4*w, memsvc_get_last_error(memsvc)));
+          }
+        }
+      }
+      offset += run.words;
+    }
+  }
 
+  // scatter back into request order
+  uint32_t nFailed = 0;
+  size_t w = 0;
+  for (unsigned int k=0; k<count; k++){
+    uint32_t i = order[k];
+    while (words[w] != addr[i]) ++w;
+    status[i] = valueStatus[w];
+    if (status[i]) ++nFailed;
+    else data[i] = values[w];
+  }
+  if (nFailed) {
+    response->set_string("error", stdsprintf("read memsvc error: %u of %u addresses failed", nFailed, count));
+  }
+	response->set_word_array("data", data);
+	response->set_word_array("status", status);
+}
+
+/*! \fn void mlistwrite(const RPCMsg *request, RPCMsg *response)
+ *  \brief Writes a list of raw addresses with one memhub lock acquisition.
+ *         Takes "addresses" and "values" arrays and an optional "masks" array: only the bits set in the mask are modified (read-modify-write),
+ *         a missing array or a mask of 0xffffffff writes the whole word. Entries are written in order, one access each.
+ *         With a non-zero "merge" word, consecutive entries hitting the same word are merged into a single access: only use it when
+ *         none of the addresses is a FIFO or command port, whose repeated writes would be collapsed
+ *         "status" holds 0 for every entry written successfully and 1 otherwise, "error" is also set if any entry failed
+ *  \param request RPC request message
+ *  \param response RPC response message
+ */
+void mlistwrite(const RPCMsg *request, RPCMsg *response) {
+  uint32_t count = request->get_word_array_size("addresses");
+  if (request->get_word_array_size("values") != count || (request->get_key_exists("masks") && request->get_word_array_size("masks") != count)) {
+    response->set_string("error", "addresses, values and masks must have the same size");
+    return;
+  }
+  std::vector<uint32_t> addr(count), value(count), mask(count, 0xffffffff);
+  request->get_word_array("addresses", addr.data());
+  request->get_word_array("values", value.data());
+  if (request->get_key_exists("masks")) request->get_word_array("masks", mask.data());
+
+  std::vector<memhub_op> ops(count);
   for (unsigned int i=0; i<count; i++){
-    if (memhub_read(memsvc, addr[i], 1, &data[i]) != 0) {
-      response->set_string("error", memsvc_get_last_error(memsvc));
-      LOGGER->log_message(LogManager::INFO, stdsprintf("read memsvc error: %s", memsvc_get_last_error(memsvc)));
-      return;
+    ops[i] = {(uint32_t)(mask[i] == 0xffffffff ? MEMHUB_WRITE : MEMHUB_RMW), addr[i], value[i], mask[i], 0};
+  }
+  std::vector<uint32_t> index(count);
+  uint32_t nops = count;
+  if (request->get_key_exists("merge") && request->get_word("merge")) {
+    nops = memhub_merge_ops(ops.data(), count, index.data());
+  } else {
+    for (unsigned int i=0; i<count; i++) index[i] = i;
+  }
+  memhub_batch(memsvc, ops.data(), nops, MEMHUB_DEFAULT_MAX_HOLD_US);
+
+  std::vector<uint32_t> status(count, 0);
+  uint32_t nFailed = 0;
+  for (unsigned int i=0; i<count; i++){
+    if (ops[index[i]].status != 0) {
+      status[i] = 1;
+      ++nFailed;
+      LOGGER->log_message(LogManager::INFO, stdsprintf("write memsvc error at %08X: %s", addr[i], memsvc_get_last_error(memsvc)));
     }
   }
-	response->set_word_array("data", data, count);
+  if (nFailed) {
+    response->set_string("error", stdsprintf("write memsvc error: %u of %u entries failed", nFailed, count));
+  }
+  response->set_word_array("status", status);
 }
+
 extern "C" {
 	const char *module_version_key = "extras v1.0.1";
 	int module_activity_color = 4;
@@ -60,5 +168,6 @@ extern "C" {
 		}
 		modmgr->register_method("extras", "blockread", mblockread);
 		modmgr->register_method("extras", "listread", mlistread);
+		modmgr->register_method("extras", "listwrite", mlistwrite);
 	}
 }
@@ -7,17 +7,237 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <string.h>
+#include <dlfcn.h>
 
 #define SEM_NAME "/memhub"
 #define SEM_PERMS (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP)
 #define SEM_INIT 1
 
+#define SHM_NAME "/memhub_locks"
+#define SHM_MAGIC 0x4d484c32 // "MHL2"
+
+/* Lock of one address stripe. The mutex is robust, so that a process killed while holding it (even by SIGKILL)
+ * hands it over to the next locker instead of wedging every other client. Owner and statistics are only written with the mutex held.
+ */
+struct memhub_stripe {
+    pthread_mutex_t mutex;
+    volatile pid_t owner;        // 0 if free
+    uint64_t acquired_ns;        // CLOCK_MONOTONIC time of the acquisition by owner
+    memhub_lock_stats stats;
+};
+
+/* Shared lock table. Every stripe guards the addresses with (addr >> MEMHUB_STRIPE_SHIFT) % MEMHUB_STRIPES equal to its index,
+ * so that processes accessing disjoint register blocks do not wait for each other.
+ * The named semaphore only serializes the initialization of the table.
+ */
+struct memhub_shared {
+    uint32_t magic;
+    uint32_t nstripes;
+    uint32_t stripe_shift;
+    memhub_stripe stripe[MEMHUB_STRIPES];
+};
+
+#define STATS_SHM_NAME "/memhub_stats"
+#define STATS_MAGIC 0x4d485331 // "MHS1"
+
+/* Statistics table, every process writes only its own slot */
+struct memhub_stats_table {
+    uint32_t magic;
+    memhub_process_stats slot[MEMHUB_STATS_SLOTS];
+};
+
+#define CALLER_CACHE_SIZE 8
+
 static sem_t *semaphore = NULL;
-static bool busy = false;
+static memhub_shared *shared = NULL;
+static __thread uint32_t held = 0; // stripes held by this thread, released by die()
+
+static memhub_stats_table *stats_table = NULL;
+static memhub_process_stats *my_stats = NULL; // slot of this process, NULL until first use and after fork
+static uint32_t stats_gen = 1; // incremented every time this process takes a new slot, invalidates the caller caches
+static pthread_mutex_t caller_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread char caller_tag[MEMHUB_CALLER_NAME_SIZE]; // set by memhub_set_caller, empty if not set
+static __thread int caller_tag_idx;
+static __thread uint32_t caller_tag_gen;
+static __thread void *caller_cache_addr[CALLER_CACHE_SIZE]; // return address -> caller index, to call dladdr only once per call site
+static __thread int caller_cache_idx[CALLER_CACHE_SIZE];
+static __thread uint32_t caller_cache_gen[CALLER_CACHE_SIZE];
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec*1000000000 + now.tv_nsec;
+}
+
+static int open_shared() {
+    int fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, SEM_PERMS);
+    if (fd < 0) {
+        perror("shm_open(3) error");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_size < (off_t)sizeof(memhub_shared) && ftruncate(fd, sizeof(memhub_shared)) != 0)) {
+        perror("ftruncate(2) error");
+        close(fd);
+        return -1;
+    }
+    void *addr = mmap(NULL, sizeof(memhub_shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("mmap(2) error");
+        return -1;
+    }
+    shared = (memhub_shared *)addr;
+
+    sem_wait(semaphore);
+    if (shared->magic != SHM_MAGIC || shared->nstripes != MEMHUB_STRIPES || shared->stripe_shift != MEMHUB_STRIPE_SHIFT) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        for (int i = 0; i < MEMHUB_STRIPES; ++i) {
+            memset(&shared->stripe[i], 0, sizeof(memhub_stripe));
+            pthread_mutex_init(&shared->stripe[i].mutex, &attr);
+        }
+        pthread_mutexattr_destroy(&attr);
+        shared->nstripes = MEMHUB_STRIPES;
+        shared->stripe_shift = MEMHUB_STRIPE_SHIFT;
+        shared->magic = SHM_MAGIC;
+        LOGGER->log_message(LogManager::INFO, stdsprintf("Memhub initialized %d address stripes\n", MEMHUB_STRIPES));
+    }
+    sem_post(semaphore);
+    return 0;
+}
+
+static int open_stats() {
+    int fd = shm_open(STATS_SHM_NAME, O_CREAT | O_RDWR, SEM_PERMS);
+    if (fd < 0) {
+        perror("shm_open(3) error");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_size < (off_t)sizeof(memhub_stats_table) && ftruncate(fd, sizeof(memhub_stats_table)) != 0)) {
+        perror("ftruncate(2) error");
+        close(fd);
+        return -1;
+    }
+    void *addr = mmap(NULL, sizeof(memhub_stats_table), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("mmap(2) error");
+        return -1;
+    }
+    stats_table = (memhub_stats_table *)addr;
+
+    sem_wait(semaphore);
+    if (stats_table->magic != STATS_MAGIC) {
+        memset(stats_table, 0, sizeof(memhub_stats_table));
+        stats_table->magic = STATS_MAGIC;
+    }
+    sem_post(semaphore);
+    return 0;
+}
+
+// A forked child must not write the statistics slot of its parent
+static void stats_atfork_child() {
+    my_stats = NULL;
+}
+
+static memhub_process_stats * process_stats() {
+    if (my_stats != NULL || stats_table == NULL) return my_stats;
+    uint32_t pid = getpid();
+    pthread_mutex_lock(&caller_mutex);
+    for (int i = 0; i < MEMHUB_STATS_SLOTS && my_stats == NULL; ++i) {
+        memhub_process_stats *slot = &stats_table->slot[i];
+        uint32_t owner = slot->pid;
+        // take a free slot or the slot of a process which does not exist anymore (possibly a previous process with the same pid)
+        if ((owner == 0 || owner == pid || (kill(owner, 0) != 0 && errno == ESRCH))
+                && __sync_bool_compare_and_swap(&slot->pid, owner, pid)) {
+            memset((char *)slot + sizeof(slot->pid), 0, sizeof(memhub_process_stats) - sizeof(slot->pid));
+            my_stats = slot;
+        }
+    }
+    ++stats_gen;
+    pthread_mutex_unlock(&caller_mutex);
+    return my_stats;
+}
+
+static int caller_index(memhub_process_stats *stats, const char *name) {
+    for (int i = 0; i < MEMHUB_MAX_CALLERS && stats->callers[i].name[0]; ++i) {
+        if (strncmp(stats->callers[i].name, name, MEMHUB_CALLER_NAME_SIZE-1) == 0) return i;
+    }
+    pthread_mutex_lock(&caller_mutex);
+    int i = 0;
+    for (; i < MEMHUB_MAX_CALLERS-1 && stats->callers[i].name[0]; ++i) {
+        if (strncmp(stats->callers[i].name, name, MEMHUB_CALLER_NAME_SIZE-1) == 0) break;
+    }
+    if (!stats->callers[i].name[0]) {
+        // the last entry collects all the callers once the table is full
+        strncpy(stats->callers[i].name, i < MEMHUB_MAX_CALLERS-1 ? name : "other", MEMHUB_CALLER_NAME_SIZE-1);
+    }
+    pthread_mutex_unlock(&caller_mutex);
+    return i;
+}
+
+static int caller_of(memhub_process_stats *stats, void *addr) {
+    if (caller_tag[0]) {
+        if (caller_tag_gen != stats_gen) {
+            caller_tag_idx = caller_index(stats, caller_tag);
+            caller_tag_gen = stats_gen;
+        }
+        return caller_tag_idx;
+    }
+    uint32_t c = ((uintptr_t)addr >> 2) % CALLER_CACHE_SIZE;
+    if (caller_cache_addr[c] != addr || caller_cache_gen[c] != stats_gen) {
+        Dl_info info;
+        const char *name = "unknown";
+        if (dladdr(addr, &info) && info.dli_fname) {
+            name = strrchr(info.dli_fname, '/') ? strrchr(info.dli_fname, '/')+1 : info.dli_fname;
+        }
+        caller_cache_idx[c] = caller_index(stats, name);
+        caller_cache_addr[c] = addr;
+        caller_cache_gen[c] = stats_gen;
+    }
+    return caller_cache_idx[c];
+}
+
+static uint32_t hist_bucket(uint64_t ns) {
+    if (ns < 4) return ns;
+    int msb = 63 - __builtin_clzll(ns);
+    uint32_t bucket = 4*(msb-1) + ((ns >> (msb-2)) & 3);
+    return bucket < MEMHUB_HIST_BUCKETS ? bucket : MEMHUB_HIST_BUCKETS-1;
+}
+
+static void account(void *addr, uint64_t wait_ns, uint64_t hold_ns, uint32_t reads, uint32_t writes) {
+    memhub_process_stats *stats = process_stats();
+    if (stats == NULL) return;
+    __atomic_fetch_add(&stats->wait_hist[hist_bucket(wait_ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->hold_hist[hist_bucket(hold_ns)], 1, __ATOMIC_RELAXED);
+    memhub_caller_stats *caller = &stats->callers[caller_of(stats, addr)];
+    __atomic_fetch_add(&caller->reads, reads, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&caller->writes, writes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&caller->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&caller->wait_ns, wait_ns, __ATOMIC_RELAXED);
+}
+
+static void account_memsvc(uint64_t ns) {
+    memhub_process_stats *stats = process_stats();
+    if (stats == NULL) return;
+    __atomic_fetch_add(&stats->memsvc_hist[hist_bucket(ns)], 1, __ATOMIC_RELAXED);
+}
 
 int memhub_open(memsvc_handle_t *handle) {
     if (semaphore == NULL) {
         semaphore = sem_open(SEM_NAME, O_CREAT, SEM_PERMS, SEM_INIT);
+        if (semaphore == SEM_FAILED) {
+            perror("sem_open(3) error");
+            exit(1);
+        }
         int semval = 0;
         sem_getvalue(semaphore, &semval);
         if (semval > 1) {
@@ -26,12 +246,14 @@ int memhub_open(memsvc_handle_t *handle) {
         }
         LOGGER->log_message(LogManager::INFO, stdsprintf("\nMemhub initialized a semaphore. Current semaphore value = %d\n", semval));
     }
-    if (semaphore == SEM_FAILED) {
-        perror("sem_open(3) error");
+    if (shared == NULL && open_shared() != 0) {
         exit(1);
     }
-   
-    // handle all signals in attempt to undo an active semaphore if the process is killed in the middle of a transaction.. 
+    if (stats_table == NULL && open_stats() == 0) {
+        pthread_atfork(NULL, NULL, stats_atfork_child);
+    }
+
+    // handle all signals in attempt to undo the active locks if the process is killed in the middle of a transaction..
     signal(SIGABRT, die);
     signal(SIGFPE, die);
     signal(SIGILL, die);
@@ -47,33 +269,336 @@ int memhub_close(memsvc_handle_t *handle) {
     return memsvc_close(handle);
 }
 
+static uint32_t stripe_of(uint32_t addr) {
+    return (addr >> MEMHUB_STRIPE_SHIFT) % MEMHUB_STRIPES;
+}
+
+// Stripes covering [addr, addr+4*words)
+static uint32_t stripes_of(uint32_t addr, uint32_t words) {
+    uint32_t mask = 0;
+    if (words == 0) return 0;
+    uint64_t first = addr >> MEMHUB_STRIPE_SHIFT;
+    uint64_t last = ((uint64_t)addr + 4*(uint64_t)words - 1) >> MEMHUB_STRIPE_SHIFT;
+    for (uint64_t b = first; b <= last && b - first < MEMHUB_STRIPES; ++b) {
+        mask |= 1u << (b % MEMHUB_STRIPES);
+    }
+    return mask;
+}
+
+// Returns 0 once the stripe is held, -1 if it could not be locked
+static int lock_stripe(int i) {
+    memhub_stripe *stripe = &shared->stripe[i];
+    bool contended = false;
+    int ret = pthread_mutex_trylock(&stripe->mutex);
+    if (ret == EBUSY) {
+        contended = true;
+        while (true) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += MEMHUB_LEASE_US/1000000;
+            deadline.tv_nsec += (MEMHUB_LEASE_US%1000000)*1000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000;
+            }
+            ret = pthread_mutex_timedlock(&stripe->mutex, &deadline);
+            if (ret != ETIMEDOUT) break;
+            // The owner is alive (a dead one would have been recovered through EOWNERDEAD) but exceeds its lease, report it and keep waiting
+            __sync_fetch_and_add(&stripe->stats.lease_expirations, 1);
+            pid_t owner = stripe->owner;
+            LOGGER->log_message(LogManager::WARNING, stdsprintf("Memhub stripe %d is held by pid %d for more than %d us\n", i, owner, MEMHUB_LEASE_US));
+        }
+    }
+    if (ret == EOWNERDEAD) {
+        LOGGER->log_message(LogManager::ERROR, stdsprintf("Memhub stripe %d owner pid %d died while holding it, recovering the lock\n", i, stripe->owner));
+        pthread_mutex_consistent(&stripe->mutex);
+        ++stripe->stats.recoveries;
+    } else if (ret != 0) {
+        LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to lock memhub stripe %d: error %d\n", i, ret));
+        return -1;
+    }
+    held |= 1u << i;
+    stripe->owner = getpid();
+    stripe->acquired_ns = now_ns();
+    ++stripe->stats.acquisitions;
+    if (contended) ++stripe->stats.contended;
+    return 0;
+}
+
+static void unlock_stripe(int i) {
+    memhub_stripe *stripe = &shared->stripe[i];
+    if (!(held & (1u << i))) return;
+    uint64_t hold = now_ns() - stripe->acquired_ns;
+    stripe->stats.total_hold_ns += hold;
+    if (hold > stripe->stats.max_hold_ns) stripe->stats.max_hold_ns = hold;
+    stripe->owner = 0;
+    held &= ~(1u << i);
+    pthread_mutex_unlock(&stripe->mutex);
+}
+
+static void unlock_stripes(uint32_t mask) {
+    for (int i = MEMHUB_STRIPES-1; i >= 0; --i) {
+        if (mask & (1u << i)) unlock_stripe(i);
+    }
+}
+
+// Stripes are always taken in ascending order, so that two batches cannot deadlock.
+// Returns -1 with no stripe of mask held if one of them could not be locked, the access must then be skipped
+static int lock_stripes(uint32_t mask) {
+    for (int i = 0; i < MEMHUB_STRIPES; ++i) {
+        if ((mask & (1u << i)) && lock_stripe(i) != 0) {
+            unlock_stripes(mask & ((1u << i) - 1));
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int memhub_read(memsvc_handle_t handle, uint32_t addr, uint32_t words, uint32_t *data) {
-    sem_wait(semaphore);
-    busy = true;
+    uint32_t mask = stripes_of(addr, words);
+    uint64_t start = now_ns();
+    if (lock_stripes(mask) != 0) return -1;
+    uint64_t locked = now_ns();
     int ret = memsvc_read(handle, addr, words, data);
-    sem_post(semaphore);
-    busy = false;
+    uint64_t done = now_ns();
+    unlock_stripes(mask);
+    account_memsvc(done - locked);
+    account(__builtin_return_address(0), locked - start, done - locked, words, 0);
+    return ret;
+}
+
+int memhub_read_fifo(memsvc_handle_t handle, uint32_t addr, uint32_t words, uint32_t *data) {
+    uint32_t mask = stripes_of(addr, 1);
+    uint64_t start = now_ns();
+    if (lock_stripes(mask) != 0) return -1;
+    uint64_t locked = now_ns();
+    uint64_t t = locked;
+    int ret = 0;
+    uint32_t i = 0;
+    for (; i < words && ret == 0; ++i) {
+        ret = memsvc_read(handle, addr, 1, &data[i]);
+        uint64_t done = now_ns();
+        account_memsvc(done - t);
+        t = done;
+    }
+    unlock_stripes(mask);
+    account(__builtin_return_address(0), locked - start, t - locked, i, 0);
     return ret;
 }
 
 int memhub_write(memsvc_handle_t handle, uint32_t addr, uint32_t words, const uint32_t *data) {
-    sem_wait(semaphore);
-    busy = true;
+    uint32_t mask = stripes_of(addr, words);
+    uint64_t start = now_ns();
+    if (lock_stripes(mask) != 0) return -1;
+    uint64_t locked = now_ns();
     int ret = memsvc_write(handle, addr, words, data);
-    sem_post(semaphore);
-    busy = false;
+    uint64_t done = now_ns();
+    unlock_stripes(mask);
+    account_memsvc(done - locked);
+    account(__builtin_return_address(0), locked - start, done - locked, 0, words);
     return ret;
 }
 
+int memhub_batch(memsvc_handle_t handle, memhub_op *ops, uint32_t nops, uint32_t max_hold_us) {
+    int failed = 0;
+    uint32_t mask = 0;
+    uint32_t reads = 0, writes = 0;
+    if (nops == 0) return 0;
+    for (uint32_t i = 0; i < nops; ++i) {
+        mask |= 1u << stripe_of(ops[i].addr);
+    }
+    for (uint32_t i = 0; i < nops; ++i) {
+        ops[i].status = -1;
+    }
+    uint64_t start = now_ns();
+    if (lock_stripes(mask) != 0) return nops;
+    uint64_t locked = now_ns();
+    uint64_t wait_ns = locked - start, hold_ns = 0;
+    uint64_t t = locked;
+    for (uint32_t i = 0; i < nops; ++i) {
+        memhub_op *op = &ops[i];
+        if (max_hold_us && i && t - locked >= (uint64_t)max_hold_us*1000) {
+            unlock_stripes(mask);
+            hold_ns += t - locked;
+            start = now_ns();
+            if (lock_stripes(mask) != 0) {
+                // the remaining operations keep their failed status
+                failed += nops - i;
+                account(__builtin_return_address(0), wait_ns, hold_ns, reads, writes);
+                return failed;
+            }
+            locked = now_ns();
+            wait_ns += locked - start;
+            t = locked;
+        }
+        switch (op->type) {
+            case MEMHUB_READ:
+                op->status = memsvc_read(handle, op->addr, 1, &op->value);
+                break;
+            case MEMHUB_WRITE:
+                op->status = memsvc_write(handle, op->addr, 1, &op->value);
+                break;
+            case MEMHUB_RMW: {
+                uint32_t data = 0;
+                op->status = memsvc_read(handle, op->addr, 1, &data);
+                if (op->status == 0) {
+                    data = (data & ~op->mask) | (op->value & op->mask);
+                    op->status = memsvc_write(handle, op->addr, 1, &data);
+                    op->value = data;
+                }
+                break;
+            }
+            default:
+                op->status = -1;
+        }
+        uint64_t done = now_ns();
+        account_memsvc(done - t);
+        t = done;
+        if (op->type != MEMHUB_WRITE) ++reads;
+        if (op->type != MEMHUB_READ) ++writes;
+        if (op->status != 0) {
+            op->status = -1;
+            ++failed;
+        }
+    }
+    unlock_stripes(mask);
+    hold_ns += t - locked;
+    account(__builtin_return_address(0), wait_ns, hold_ns, reads, writes);
+    return failed;
+}
+
+int memhub_get_lock_stats(uint32_t stripe, memhub_lock_stats *stats) {
+    if (shared == NULL || stripe >= MEMHUB_STRIPES) return -1;
+    *stats = shared->stripe[stripe].stats;
+    stats->owner = shared->stripe[stripe].owner;
+    return 0;
+}
+
+void memhub_reset_lock_stats() {
+    if (shared == NULL) return;
+    for (int i = 0; i < MEMHUB_STRIPES; ++i) {
+        if (lock_stripe(i) != 0) continue;
+        memset(&shared->stripe[i].stats, 0, sizeof(memhub_lock_stats));
+        shared->stripe[i].acquired_ns = now_ns(); // do not account the reset itself
+        unlock_stripe(i);
+    }
+}
+
+uint32_t memhub_merge_ops(memhub_op *ops, uint32_t nops, uint32_t *index) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < nops; ++i) {
+        memhub_op op = ops[i];
+        if (op.type == MEMHUB_WRITE || op.type == MEMHUB_RMW) {
+            uint32_t mask = op.type == MEMHUB_WRITE ? 0xffffffff : op.mask;
+            // only fold into the directly preceding write of the same word, so that no access is reordered
+            memhub_op *prev = n ? &ops[n-1] : NULL;
+            if (prev && prev->addr == op.addr && (prev->type == MEMHUB_WRITE || prev->type == MEMHUB_RMW)) {
+                uint32_t prev_mask = prev->type == MEMHUB_WRITE ? 0xffffffff : prev->mask;
+                prev->value = (prev->value & ~mask) | (op.value & mask);
+                prev->mask = prev_mask | mask;
+                prev->type = prev->mask == 0xffffffff ? MEMHUB_WRITE : MEMHUB_RMW;
+                index[i] = n-1;
+                continue;
+            }
+            if (mask == 0xffffffff) op.type = MEMHUB_WRITE;
+            op.mask = mask;
+        }
+        ops[n] = op;
+        index[i] = n++;
+    }
+    return n;
+}
+
+int memhub_read_runs(memsvc_handle_t handle, memhub_run *runs, uint32_t nruns, uint32_t max_hold_us) {
+    int failed = 0;
+    uint32_t mask = 0;
+    uint32_t reads = 0;
+    if (nruns == 0) return 0;
+    for (uint32_t i = 0; i < nruns; ++i) {
+        mask |= stripes_of(runs[i].addr, runs[i].words);
+    }
+    for (uint32_t i = 0; i < nruns; ++i) {
+        runs[i].status = -1;
+    }
+    uint64_t start = now_ns();
+    if (lock_stripes(mask) != 0) return nruns;
+    uint64_t locked = now_ns();
+    uint64_t wait_ns = locked - start, hold_ns = 0;
+    uint64_t t = locked;
+    for (uint32_t i = 0; i < nruns; ++i) {
+        memhub_run *run = &runs[i];
+        if (max_hold_us && i && t - locked >= (uint64_t)max_hold_us*1000) {
+            unlock_stripes(mask);
+            hold_ns += t - locked;
+            start = now_ns();
+            if (lock_stripes(mask) != 0) {
+                // the remaining runs keep their failed status
+                failed += nruns - i;
+                account(__builtin_return_address(0), wait_ns, hold_ns, reads, 0);
+                return failed;
+            }
+            locked = now_ns();
+            wait_ns += locked - start;
+            t = locked;
+        }
+        run->status = memsvc_read(handle, run->addr, run->words, run->data) == 0 ? 0 : -1;
+        uint64_t done = now_ns();
+        account_memsvc(done - t);
+        t = done;
+        reads += run->words;
+        if (run->status != 0) ++failed;
+    }
+    unlock_stripes(mask);
+    hold_ns += t - locked;
+    account(__builtin_return_address(0), wait_ns, hold_ns, reads, 0);
+    return failed;
+}
+
+void memhub_set_caller(const char *name) {
+    if (name == NULL) {
+        caller_tag[0] = 0;
+        return;
+    }
+    strncpy(caller_tag, name, MEMHUB_CALLER_NAME_SIZE-1);
+    caller_tag_gen = 0;
+}
+
+int memhub_get_process_stats(uint32_t slot, memhub_process_stats *stats) {
+    if (stats_table == NULL || slot >= MEMHUB_STATS_SLOTS || stats_table->slot[slot].pid == 0) return -1;
+    memcpy(stats, &stats_table->slot[slot], sizeof(memhub_process_stats));
+    return 0;
+}
+
+void memhub_reset_stats() {
+    if (stats_table == NULL) return;
+    for (int i = 0; i < MEMHUB_STATS_SLOTS; ++i) {
+        memhub_process_stats *slot = &stats_table->slot[i];
+        memset(slot->wait_hist, 0, sizeof(slot->wait_hist));
+        memset(slot->hold_hist, 0, sizeof(slot->hold_hist));
+        memset(slot->memsvc_hist, 0, sizeof(slot->memsvc_hist));
+        for (int c = 0; c < MEMHUB_MAX_CALLERS; ++c) {
+            // names are kept, the caller indices cached by the processes stay valid
+            slot->callers[c].reads = 0;
+            slot->callers[c].writes = 0;
+            slot->callers[c].calls = 0;
+            slot->callers[c].wait_ns = 0;
+        }
+    }
+}
+
+uint64_t memhub_hist_bucket_ns(uint32_t bucket) {
+    if (bucket < 4) return bucket;
+    uint32_t msb = bucket/4 + 1;
+    return (uint64_t)(4 + bucket%4) << (msb-2);
+}
+
 void die(int signo) {
-    int semval = 0;
-    sem_getvalue(semaphore, &semval);
-    
-    if (busy && (semval == 0)) {
-        LOGGER->log_message(LogManager::ERROR, stdsprintf("[!] Application is dying, trying to undo an active semaphore..\n"));
-        sem_post(semaphore);
-    }
-    LOGGER->log_message(LogManager::ERROR, stdsprintf("[!] Application was killed or died with signal %d (semaphore value at the time of the kill = %d)...\n", signo, semval));
+    uint32_t mask = held;
+    if (mask) {
+        // Not strictly needed with robust locks, but spares the next client the recovery
+        LOGGER->log_message(LogManager::ERROR, stdsprintf("[!] Application is dying, releasing the held memhub stripes %08x..\n", mask));
+        unlock_stripes(mask);
+    }
+    LOGGER->log_message(LogManager::ERROR, stdsprintf("[!] Application was killed or died with signal %d (held stripes at the time of the kill = %08x)...\n", signo, mask));
     exit(1);
 }
-
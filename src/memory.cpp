@@ -1,6 +1,9 @@
 #include "moduleapi.h"
 #include <libmemsvc.h>
 #include "memhub.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 memsvc_handle_t memsvc;
 
@@ -30,6 +33,81 @@ void mwrite(const RPCMsg *request, RPCMsg *response) {
 	}
 }
 
+void lockStats(const RPCMsg *request, RPCMsg *response) {
+	uint32_t acquisitions[MEMHUB_STRIPES], contended[MEMHUB_STRIPES], recoveries[MEMHUB_STRIPES], leaseExpirations[MEMHUB_STRIPES];
+	uint32_t maxHoldUs[MEMHUB_STRIPES], totalHoldUs[MEMHUB_STRIPES], owner[MEMHUB_STRIPES];
+	for (uint32_t i = 0; i < MEMHUB_STRIPES; ++i) {
+		memhub_lock_stats stats;
+		if (memhub_get_lock_stats(i, &stats) != 0) {
+			response->set_string("error", "memhub lock table is not available");
+			return;
+		}
+		// counters are reported modulo 2^32
+		acquisitions[i] = stats.acquisitions;
+		contended[i] = stats.contended;
+		recoveries[i] = stats.recoveries;
+		leaseExpirations[i] = stats.lease_expirations;
+		maxHoldUs[i] = stats.max_hold_ns/1000;
+		totalHoldUs[i] = stats.total_hold_ns/1000;
+		owner[i] = stats.owner;
+	}
+	response->set_word_array("acquisitions", acquisitions, MEMHUB_STRIPES);
+	response->set_word_array("contended", contended, MEMHUB_STRIPES);
+	response->set_word_array("recoveries", recoveries, MEMHUB_STRIPES);
+	response->set_word_array("leaseExpirations", leaseExpirations, MEMHUB_STRIPES);
+	response->set_word_array("maxHoldUs", maxHoldUs, MEMHUB_STRIPES);
+	response->set_word_array("totalHoldUs", totalHoldUs, MEMHUB_STRIPES);
+	response->set_word_array("owner", owner, MEMHUB_STRIPES);
+	if (request->get_key_exists("reset") && request->get_word("reset")) {
+		memhub_reset_lock_stats();
+	}
+}
+
+void stats(const RPCMsg *request, RPCMsg *response) {
+	std::vector<uint32_t> bucketNs(MEMHUB_HIST_BUCKETS);
+	std::vector<uint32_t> pids;
+	std::vector<std::string> callers;
+	std::vector<uint32_t> callerReads, callerWrites, callerCalls, callerWaitUs;
+	for (uint32_t b = 0; b < MEMHUB_HIST_BUCKETS; ++b) {
+		uint64_t ns = memhub_hist_bucket_ns(b);
+		bucketNs[b] = ns > 0xffffffff ? 0xffffffff : ns;
+	}
+	response->set_word_array("bucketNs", bucketNs);
+	for (uint32_t slot = 0; slot < MEMHUB_STATS_SLOTS; ++slot) {
+		memhub_process_stats ps;
+		if (memhub_get_process_stats(slot, &ps) != 0) continue;
+		pids.push_back(ps.pid);
+		response->set_word_array(stdsprintf("%u.waitHist", ps.pid), ps.wait_hist, MEMHUB_HIST_BUCKETS);
+		response->set_word_array(stdsprintf("%u.holdHist", ps.pid), ps.hold_hist, MEMHUB_HIST_BUCKETS);
+		response->set_word_array(stdsprintf("%u.memsvcHist", ps.pid), ps.memsvc_hist, MEMHUB_HIST_BUCKETS);
+		for (int c = 0; c < MEMHUB_MAX_CALLERS && ps.callers[c].name[0]; ++c) {
+			std::string name(ps.callers[c].name, strnlen(ps.callers[c].name, MEMHUB_CALLER_NAME_SIZE));
+			size_t i = std::find(callers.begin(), callers.end(), name) - callers.begin();
+			if (i == callers.size()) {
+				callers.push_back(name);
+				callerReads.push_back(0);
+				callerWrites.push_back(0);
+				callerCalls.push_back(0);
+				callerWaitUs.push_back(0);
+			}
+			// counters are reported modulo 2^32
+			callerReads[i] += ps.callers[c].reads;
+			callerWrites[i] += ps.callers[c].writes;
+			callerCalls[i] += ps.callers[c].calls;
+			callerWaitUs[i] += ps.callers[c].wait_ns/1000;
+		}
+	}
+	response->set_word_array("pids", pids);
+	response->set_string_array("callers", callers);
+	response->set_word_array("callerReads", callerReads);
+	response->set_word_array("callerWrites", callerWrites);
+	response->set_word_array("callerCalls", callerCalls);
+	response->set_word_array("callerWaitUs", callerWaitUs);
+	if (request->get_key_exists("reset") && request->get_word("reset")) {
+		memhub_reset_stats();
+	}
+}
+
 extern "C" {
 	const char *module_version_key = "memory v1.0.1";
 	int module_activity_color = 4;
@@ -41,5 +119,7 @@ extern "C" {
 		}
 		modmgr->register_method("memory", "read", mread);
 		modmgr->register_method("memory", "write", mwrite);
+		modmgr->register_method("memory", "lockStats", lockStats);
+		modmgr->register_method("memory", "stats", stats);
 	}
 }
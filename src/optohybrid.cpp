@@ -1,101 +1,160 @@
+#include <algorithm>
 #include "amc.h"
+#include "hw_policy.h"
 #include "optohybrid.h"
 
-void broadcastWriteLocal(localArgs * la, uint32_t ohN, std::string regName, uint32_t value, uint32_t mask) {
-  uint32_t fw_maj = readReg(la, "GEM_AMC.GEM_SYSTEM.RELEASE.MAJOR");
-  if (fw_maj == 1) {
-    char regBase [100];
-    sprintf(regBase, "GEM_AMC.OH.OH%i.GEB.Broadcast",ohN);
-
-    std::string t_regName;
-
-    //Reset broadcast module
-    t_regName = std::string(regBase) + ".Reset";
-    writeRawReg(la, t_regName, 0);
-    //Set broadcast mask
-    t_regName = std::string(regBase) + ".Mask";
-    writeRawReg(la, t_regName, mask);
-    //Issue broadcast write request
-    t_regName = std::string(regBase) + ".Request." + regName;
-    writeRawReg(la, t_regName, value);
-    //Wait until broadcast write finishes
-    t_regName = std::string(regBase) + ".Running";
-    while (unsigned int t_res = readRawReg(la, t_regName))
-    {
-      if (t_res == 0xdeaddead) break;
-      usleep(1000);
+void V2bPolicy::broadcastWrite(localArgs * la, uint32_t ohN, const std::string & regName, uint32_t value, uint32_t mask) {
+  char regBase [100];
+  sprintf(regBase, "GEM_AMC.OH.OH%i.GEB.Broadcast",ohN);
+
+  std::string t_regName;
+
+  //Reset broadcast module
+  t_regName = std::string(regBase) + ".Reset";
+  writeRawReg(la, t_regName, 0);
+  //Set broadcast mask
+  t_regName = std::string(regBase) + ".Mask";
+  writeRawReg(la, t_regName, mask);
+  //Issue broadcast write request
+  t_regName = std::string(regBase) + ".Request." + regName;
+  writeRawReg(la, t_regName, value);
+  //Wait until broadcast write finishes
+  t_regName = std::string(regBase) + ".Running";
+  regInfo running;
+  if (!getRegInfo(la, t_regName, running)) {
+    LOGGER->log_message(LogManager::ERROR, stdsprintf("Key: %s is NOT found", t_regName.c_str()));
+    return;
+  }
+  running.mask = 0xFFFFFFFF; //the whole word is polled, as by readRawReg
+  running.shift = 0;
+  regWait broadcastDone(running, 10, 1000);
+  uint32_t runningValue;
+  if (!broadcastDone.until([](uint32_t v) { return v == 0x0; }, 1000000, &runningValue)) {
+    if (runningValue == 0xdeaddead) {
+      LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to read %s while waiting for the broadcast write of %s", t_regName.c_str(), regName.c_str()));
+    } else {
+      LOGGER->log_message(LogManager::ERROR, stdsprintf("Broadcast write of %s on OH%i did not finish within 1 s", regName.c_str(), ohN));
     }
-  } else if (fw_maj == 3) {
-    std::string t_regName;
-    for (int vfatN=0; vfatN<24; vfatN++){
-      if (!((mask >> vfatN)&0x1)) {
-        char regBase [100];
-        sprintf(regBase, "GEM_AMC.OH.OH%i.GEB.VFAT%i.",ohN, vfatN);
-        t_regName = std::string(regBase)+regName;
-        writeReg(la, t_regName, value);
-      }
+  }
+}
+
+void V3Policy::broadcastWrite(localArgs * la, uint32_t ohN, const std::string & regName, uint32_t value, uint32_t mask) {
+  //A hardware broadcast writes the full register word of every VFAT, so it is only used for unmasked VFATs and registers without sub-fields
+  regInfo broadcastReg;
+  if (getFwCapabilities(la).hasVfatBroadcast && !(mask & 0xFFFFFF)
+      && getRegInfo(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT_BROADCAST.%s", ohN, regName.c_str()), broadcastReg)
+      && broadcastReg.mask == 0xFFFFFFFF) {
+    writeReg(la, broadcastReg, value);
+    return;
+  }
+
+  //Otherwise write the unmasked VFATs in one batch, the read of masked registers is done in the same memhub lock hold
+  regArray regs;
+  if (!getVFATRegArray(la, ohN, regName, regs)) return;
+  regBatch batch;
+  for (int vfatN=0; vfatN<24; vfatN++){
+    if (!((mask >> vfatN)&0x1)) {
+      batch.write(regs.at(vfatN), value);
     }
-  } else {
-    LOGGER->log_message(LogManager::ERROR, stdsprintf("Unexpected value for system release major: %i",fw_maj));
   }
+  if (batch.execute(la) != 0) {
+    la->response->set_string("error", stdsprintf("Broadcast write of %s on OH%i failed", regName.c_str(), ohN));
+  }
+}
+
+void broadcastWriteLocal(localArgs * la, uint32_t ohN, std::string regName, uint32_t value, uint32_t mask) {
+  withFwPolicy(la, "broadcastWrite", [&](auto policy) {
+    decltype(policy)::broadcastWrite(la, ohN, regName, value, mask);
+  });
 }
 
 void broadcastWrite(const RPCMsg *request, RPCMsg *response) {
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
+  addressTableTxn atxn;
   std::string regName = request->get_string("reg_name");
   uint32_t value = request->get_word("value");
   uint32_t mask = request->get_key_exists("mask")?request->get_word("mask"):0xFF000000;
   uint32_t ohN = request->get_word("ohN");
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
   broadcastWriteLocal(&la, ohN, regName, value, mask);
-  rtxn.abort();
 }
 
-void broadcastReadLocal(localArgs * la, uint32_t * outData, uint32_t ohN, std::string regName, uint32_t mask) {
-  uint32_t fw_maj = readReg(la, "GEM_AMC.GEM_SYSTEM.RELEASE.MAJOR");
-  char regBase [100];
-  if (fw_maj == 1) {
-    sprintf(regBase,"GEM_AMC.OH.OH%i.GEB.VFATS.VFAT",ohN);
-  } else if (fw_maj == 3) {
-    sprintf(regBase,"GEM_AMC.OH.OH%i.GEB.VFAT",ohN);
-   } else {
-    LOGGER->log_message(LogManager::ERROR, "Unexpected value for system release major!");
-    la->response->set_string("error", "Unexpected value for system release major!");
-  }
+template<typename Policy>
+static void broadcastReadT(localArgs * la, uint32_t * outData, uint32_t ohN, const std::string & regName, uint32_t mask) {
   std::string t_regName;
   for (int i=0; i<24; i++){
     if ((mask >> i)&0x1) outData[i] = 0;
     else {
-      t_regName = std::string(regBase) + std::to_string(i)+"."+regName;
+      t_regName = vfatRegName<Policy>(ohN, i, regName);
       outData[i] = readReg(la, t_regName);
       if (outData[i] == 0xdeaddead) la->response->set_string("error",stdsprintf("Error reading register %s",t_regName.c_str()));
     }
   }
+}
+
+void broadcastReadLocal(localArgs * la, uint32_t * outData, uint32_t ohN, std::string regName, uint32_t mask) {
+  withFwPolicy(la, "broadcastRead", [&](auto policy) {
+    broadcastReadT<decltype(policy)>(la, outData, ohN, regName, mask);
+  });
   return;
 }
 
 void broadcastRead(const RPCMsg *request, RPCMsg *response) {
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
+  addressTableTxn atxn;
   std::string regName = request->get_string("reg_name");
   uint32_t mask = request->get_key_exists("mask")?request->get_word("mask"):0xFF000000;
   uint32_t ohN = request->get_word("ohN");
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
   uint32_t outData[24];
   broadcastReadLocal(&la, outData, ohN, regName, mask);
   response->set_word_array("data", outData, 24);
-  rtxn.abort();
+}
+
+bool broadcastReadMultiLocal(localArgs * la, uint32_t * outData, uint32_t ohMask, const std::vector<std::string> & regNames, const uint32_t * vfatMasks) {
+  std::fill(outData, outData + regNames.size()*12*24, 0);
+  bool found = true;
+  bool knownFw = withFwPolicy(la, "broadcastReadMulti", [&](auto policy) {
+    typedef decltype(policy) Policy;
+    regBatch batch;
+    std::vector<std::pair<size_t, size_t> > outIdx; //(output index, batch index)
+    for (size_t regN = 0; regN < regNames.size() && found; ++regN) {
+      for (uint32_t ohN = 0; ohN < 12; ++ohN) {
+        if (!((ohMask >> ohN) & 0x1)) continue;
+        regArray regs;
+        if (!getRegArray(la, stdsprintf("GEM_AMC.OH.OH%i.%s", ohN, Policy::vfatNode()), 24, "."+regNames[regN], regs)) {
+          found = false;
+          break;
+        }
+        uint32_t vfatMask = vfatMasks ? vfatMasks[ohN] : 0xFF000000;
+        for (uint32_t vfatN = 0; vfatN < 24; ++vfatN) {
+          if ((vfatMask >> vfatN) & 0x1) continue;
+          outIdx.push_back(std::make_pair((regN*12 + ohN)*24 + vfatN, batch.read(regs.at(vfatN))));
+        }
+      }
+    }
+    if (!found) return;
+    if (batch.execute(la) != 0) la->response->set_string("error", "Error reading VFAT registers");
+    for (auto & idx : outIdx) outData[idx.first] = batch.result(idx.second);
+  });
+  return knownFw && found;
+}
+
+void broadcastReadMulti(const RPCMsg *request, RPCMsg *response) {
+  addressTableTxn atxn;
+  std::vector<std::string> regNames = request->get_string_array("reg_names");
+  uint32_t ohMask = request->get_word("ohMask");
+  uint32_t vfatMasks[12];
+  std::fill(vfatMasks, vfatMasks + 12, 0xFF000000);
+  if (request->get_key_exists("vfatMasks")) {
+    if (request->get_word_array_size("vfatMasks") != 12) {
+      response->set_string("error", "vfatMasks must have 12 words");
+      return;
+    }
+    request->get_word_array("vfatMasks", vfatMasks);
+  }
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
+  std::vector<uint32_t> outData(regNames.size()*12*24);
+  if (!broadcastReadMultiLocal(&la, outData.data(), ohMask, regNames, vfatMasks)) return;
+  setWordArray(request, response, "data", outData.data(), outData.size());
 }
 
 // Set default values to VFAT parameters. VFATs will remain in sleep mode
@@ -107,33 +166,19 @@ void biasAllVFATsLocal(localArgs * la, uint32_t ohN, uint32_t mask) {
 }
 
 void setAllVFATsToRunModeLocal(localArgs * la, uint32_t ohN, uint32_t mask) {
-    switch(fw_version_check("setAllVFATsToRunMode", la)){
-        case 3:
-            broadcastWriteLocal(la, ohN, "CFG_RUN", 0x1, mask);
-            break;
-        case 1:
-            broadcastWriteLocal(la, ohN, "ContReg0", 0x37, mask);
-            break;
-        default:
-            LOGGER->log_message(LogManager::ERROR, "Unexpected value for system release major, do nothing");
-            break;
-    }
+    withFwPolicy(la, "setAllVFATsToRunMode", [&](auto policy) {
+        typedef decltype(policy) Policy;
+        Policy::broadcastWrite(la, ohN, Policy::runModeReg(), Policy::runModeOn, mask);
+    });
 
     return;
 }
 
 void setAllVFATsToSleepModeLocal(localArgs * la, uint32_t ohN, uint32_t mask) {
-    switch(fw_version_check("setAllVFATsToRunMode", la)){
-        case 3:
-            broadcastWriteLocal(la, ohN, "CFG_RUN", 0x0, mask);
-            break;
-        case 1:
-            broadcastWriteLocal(la, ohN, "ContReg0", 0x36, mask);
-            break;
-        default:
-            LOGGER->log_message(LogManager::ERROR, "Unexpected value for system release major, do nothing");
-            break;
-    }
+    withFwPolicy(la, "setAllVFATsToSleepMode", [&](auto policy) {
+        typedef decltype(policy) Policy;
+        Policy::broadcastWrite(la, ohN, Policy::runModeReg(), Policy::runModeOff, mask);
+    });
 
     return;
 }
@@ -172,25 +217,19 @@ void loadVT1Local(localArgs * la, uint32_t ohN, std::string config_file, uint32_
 }
 
 void loadVT1(const RPCMsg *request, RPCMsg *response) {
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
+  addressTableTxn atxn;
   uint32_t ohN = request->get_word("ohN");
   std::string config_file = request->get_key_exists("thresh_config_filename")?request->get_string("thresh_config_filename"):"";
   uint32_t vt1 = request->get_key_exists("vt1")?request->get_word("vt1"):0x64;
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
   loadVT1Local(&la, ohN, config_file, vt1);
-  rtxn.abort();
 }
 
 void loadTRIMDACLocal(localArgs * la, uint32_t ohN, std::string config_file) {
   std::ifstream infile(config_file);
   std::string line, regName;
   uint32_t vfatN, vfatCH, trim, mask;
+  regBatch batch;
   std::getline(infile,line);// skip first line
   while (std::getline(infile,line))
   {
@@ -203,39 +242,27 @@ void loadTRIMDACLocal(localArgs * la, uint32_t ohN, std::string config_file) {
       char regBase [100];
       sprintf(regBase,"GEM_AMC.OH.OH%i.GEB.VFATS.VFAT%i.VFATChannels.ChanReg%i",ohN, vfatN, vfatCH);
       regName = std::string(regBase);
-      writeRawReg(la, regName, trim + 32*mask);
+      batch.writeRaw(la, regName, trim + 32*mask);
     }
   }
+  batch.execute(la);
 }
 
 void loadTRIMDAC(const RPCMsg *request, RPCMsg *response) {
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
+  addressTableTxn atxn;
   uint32_t ohN = request->get_word("ohN");
   std::string config_file = request->get_string("trim_config_filename");//"/mnt/persistent/texas/test/chConfig_GEMINIm01L1.txt";
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
   loadTRIMDACLocal(&la, ohN, config_file);
-  rtxn.abort();
 }
 
 void configureVFATs(const RPCMsg *request, RPCMsg *response) {
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
+  addressTableTxn atxn;
   uint32_t ohN = request->get_word("ohN");
   std::string trim_config_file = request->get_string("trim_config_filename");//"/mnt/persistent/texas/test/chConfig_GEMINIm01L1.txt";
   std::string thresh_config_file = request->get_key_exists("thresh_config_filename")?request->get_string("thresh_config_filename"):"";
   uint32_t vt1 = request->get_key_exists("vt1")?request->get_word("vt1"):0x64;
-  struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+  struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
   LOGGER->log_message(LogManager::INFO, "BIAS VFATS");
   biasAllVFATsLocal(&la, ohN);
   LOGGER->log_message(LogManager::INFO, "LOAD VT1 VFATS");
@@ -243,7 +270,6 @@ void configureVFATs(const RPCMsg *request, RPCMsg *response) {
   LOGGER->log_message(LogManager::INFO, "LOAD TRIM VFATS");
   loadTRIMDACLocal(&la, ohN, trim_config_file);
   if (request->get_key_exists("set_run")) setAllVFATsToRunModeLocal(&la, ohN);
-  rtxn.abort();
 }
 
 void configureScanModuleLocal(localArgs * la, uint32_t ohN, uint32_t vfatN, uint32_t scanmode, bool useUltra, uint32_t mask, uint32_t ch, uint32_t nevts, uint32_t dacMin, uint32_t dacMax, uint32_t dacStep){
@@ -305,13 +331,7 @@ void configureScanModule(const RPCMsg *request, RPCMsg *response){
      *            for ULTRA scan, specify the VFAT mask
      */
 
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     //Get OH and scanmode
     uint32_t ohN = request->get_word("ohN");
@@ -335,7 +355,7 @@ void configureScanModule(const RPCMsg *request, RPCMsg *response){
     uint32_t dacMax = request->get_word("dacMax");
     uint32_t dacStep = request->get_word("dacStep");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     configureScanModuleLocal(&la, ohN, vfatN, scanmode, useUltra, mask, ch, nevts, dacMin, dacMax, dacStep);
 
     return;
@@ -382,13 +402,7 @@ void printScanConfigurationLocal(localArgs * la, uint32_t ohN, bool useUltra){
 } //End printScanConfigurationLocal(...)
 
 void printScanConfiguration(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
 
@@ -397,7 +411,7 @@ void printScanConfiguration(const RPCMsg *request, RPCMsg *response){
         useUltra = true;
     }
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     printScanConfigurationLocal(&la, ohN, useUltra);
 
     return;
@@ -440,13 +454,7 @@ void startScanModuleLocal(localArgs * la, uint32_t ohN, bool useUltra){
 } //End startScanModuleLocal(...)
 
 void startScanModule(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
 
@@ -455,7 +463,7 @@ void startScanModule(const RPCMsg *request, RPCMsg *response){
         useUltra = true;
     }
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     startScanModuleLocal(&la, ohN, useUltra);
 
     return;
@@ -523,13 +531,7 @@ void getUltraScanResultsLocal(localArgs * la, uint32_t *outData, uint32_t ohN, u
 } //End getUltraScanResultsLocal(...)
 
 void getUltraScanResults(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t nevts = request->get_word("nevts");
@@ -537,7 +539,7 @@ void getUltraScanResults(const RPCMsg *request, RPCMsg *response){
     uint32_t dacMax = request->get_word("dacMax");
     uint32_t dacStep = request->get_word("dacStep");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     uint32_t outData[24*(dacMax-dacMin+1)/dacStep];
     getUltraScanResultsLocal(&la, outData, ohN, nevts, dacMin, dacMax, dacStep);
     response->set_word_array("data",outData,24*(dacMax-dacMin+1)/dacStep);
@@ -545,53 +547,47 @@ void getUltraScanResults(const RPCMsg *request, RPCMsg *response){
     return;
 } //End getUltraScanResults(...)
 
-void stopCalPulse2AllChannelsLocal(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t ch_min, uint32_t ch_max){
-    //Get FW release
-    uint32_t fw_maj = readReg(la, "GEM_AMC.GEM_SYSTEM.RELEASE.MAJOR");
+template<typename Policy>
+static void stopCalPulseChannel(localArgs *la, uint32_t ohN, uint32_t vfatN, uint32_t chan);
 
-    if (fw_maj == 1){
-        uint32_t trimVal=0;
+template<>
+void stopCalPulseChannel<V2bPolicy>(localArgs *la, uint32_t ohN, uint32_t vfatN, uint32_t chan){
+    std::string regName = channelRegName<V2bPolicy>(ohN, vfatN, chan);
+    uint32_t trimVal = (0x3f & readReg(la, regName));
+    writeReg(la, regName, trimVal);
+}
+
+template<>
+void stopCalPulseChannel<V3Policy>(localArgs *la, uint32_t ohN, uint32_t vfatN, uint32_t chan){
+    writeReg(la, channelRegName<V3Policy>(ohN, vfatN, chan, "CALPULSE_ENABLE"), 0x0);
+}
+
+void stopCalPulse2AllChannelsLocal(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t ch_min, uint32_t ch_max){
+    withFwPolicy(la, "stopCalPulse2AllChannels", [&](auto policy) {
         for(int vfatN=0; vfatN<24; ++vfatN){
             if ((mask >> vfatN) & 0x1) continue; //skip masked VFATs
             for(uint32_t chan=ch_min; chan<ch_max; ++chan){
-                trimVal = (0x3f & readReg(la, stdsprintf("GEM_AMC.OH.OH%d.GEB.VFATS.VFAT%d.VFATChannels.ChanReg%d",ohN,vfatN,chan)));
-                writeReg(la, stdsprintf("GEM_AMC.OH.OH%d.GEB.VFATS.VFAT%d.VFATChannels.ChanReg%d",ohN,vfatN,chan),trimVal);
                 if(chan>127){
                     LOGGER->log_message(LogManager::ERROR, stdsprintf("OH %d: Chan %d greater than possible chan_max %d",ohN,chan,ch_max));
+                    break;
                 }
+                stopCalPulseChannel<decltype(policy)>(la, ohN, vfatN, chan);
             }
         }
-    }
-    else if (fw_maj == 3){
-        for(int vfatN = 0; vfatN < 24; vfatN++){
-            if ((mask >> vfatN) & 0x1) continue; //skip masked VFATs
-            for(uint32_t chan=ch_min; chan<ch_max; ++chan){
-                writeReg(la, stdsprintf("GEM_AMC.OH.OH%d.GEB.VFAT%d.VFAT_CHANNELS.CHANNEL%d.CALPULSE_ENABLE", ohN, vfatN, chan), 0x0);
-            }
-        }
-    }
-    else {
-        LOGGER->log_message(LogManager::ERROR, stdsprintf("Unexpected value for system release major: %i",fw_maj));
-    }
+    });
 
     return;
 }
 
 void stopCalPulse2AllChannels(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t mask = request->get_word("mask");
     uint32_t ch_min = request->get_word("ch_min");
     uint32_t ch_max = request->get_word("ch_max");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     stopCalPulse2AllChannelsLocal(&la, ohN, mask, ch_min, ch_max);
 
     return;
@@ -623,6 +619,7 @@ void statusOHLocal(localArgs * la, uint32_t ohEnMask){
                            "CLOCKING.CLOCKING.GBT_MMCM_UNLOCKED_CNT",
                            "CLOCKING.CLOCKING.LOGIC_MMCM_UNLOCKED_CNT"};
     std::string regName;
+    regBatch batch;
 
     for(int ohN = 0; ohN < 12; ohN++) if((ohEnMask >> ohN) & 0x1)
 
@@ -631,26 +628,20 @@ void statusOHLocal(localArgs * la, uint32_t ohEnMask){
         sprintf(regBase, "GEM_AMC.OH.OH%i.",ohN);
         for (auto &reg : regs) {
             regName = std::string(regBase)+reg;
-            la->response->set_word(regName,readReg(la,regName));
+            batch.read(la,regName,regName);
         }
     }
+    batch.execute(la);
 }
 
 void statusOH(const RPCMsg *request, RPCMsg *response)
 {
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
     uint32_t ohEnMask = request->get_word("ohEnMask");
     LOGGER->log_message(LogManager::INFO, "Reeading OH status");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     statusOHLocal(&la, ohEnMask);
-    rtxn.abort();
 }
 
 extern "C" {
@@ -662,7 +653,9 @@ extern "C" {
             LOGGER->log_message(LogManager::ERROR, "Unable to load module");
             return; // Do not register our functions, we depend on memsvc.
         }
+        openAddressTable();
         modmgr->register_method("optohybrid", "broadcastRead", broadcastRead);
+        modmgr->register_method("optohybrid", "broadcastReadMulti", broadcastReadMulti);
         modmgr->register_method("optohybrid", "broadcastWrite", broadcastWrite);
         modmgr->register_method("optohybrid", "configureScanModule", configureScanModule);
         modmgr->register_method("optohybrid", "configureVFATs", configureVFATs);
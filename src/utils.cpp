@@ -1,4 +1,260 @@
 #include "utils.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <dlfcn.h>
+
+/*! \struct regIndexHeader
+ *  Header of the register index sidecar file written by update_address_table next to the LMDB database.
+ *  The file is an open addressing hash table of regIndexSlot followed by a pool of NUL terminated register names.
+ *  It is memory mapped as is, so opening it costs the same whatever the size of the address table
+ */
+struct regIndexHeader {
+    uint32_t magic; /*!< REG_INDEX_MAGIC */
+    uint32_t nSlots; /*!< Number of hash table slots, power of 2 */
+    uint32_t nEntries; /*!< Number of registers */
+    uint32_t keysOffset; /*!< Offset of the register name pool from the beginning of the file */
+    uint32_t fileSize; /*!< Total size of the file */
+    uint32_t reserved;
+    uint64_t stamp; /*!< Identifier of the address table version, also stored in LMDB under REG_INDEX_STAMP_KEY */
+};
+
+/*! \struct regIndexSlot
+ *  Hash table slot of the register index. Empty slots have keyOffset equal to 0
+ */
+struct __attribute__((packed)) regIndexSlot {
+    uint32_t hash; /*!< Hash of the register name */
+    uint32_t keyOffset; /*!< Offset of the register name in the name pool */
+    regInfo info; /*!< Register descriptor */
+};
+
+static const uint32_t REG_INDEX_MAGIC = 0x58495247; /// \var "GRIX"
+static const char * REG_INDEX_STAMP_KEY = "__REG_INDEX_STAMP__"; /// \var LMDB key of the stamp of the matching index file
+
+static const char * at_index = nullptr; /// \var memory mapped register index, nullptr if missing or not matching the LMDB database
+static size_t at_index_size = 0;
+static ino_t at_index_ino = 0; /// \var inode of the register index file seen at last (re)open, 0 if there was none
+
+static uint32_t regIndexHash(const char * key, size_t len) {
+  // 32-bit FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= (uint8_t)key[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static std::string regIndexFile() {
+  std::string gem_path = std::getenv("GEM_PATH");
+  return gem_path+"/address_table.idx";
+}
+
+static bool writeRegIndex(const std::unordered_map<std::string,xhal::utils::Node> & nodes, uint64_t stamp) {
+  uint32_t nSlots = 1;
+  while (nSlots < nodes.size()*2) nSlots <<= 1;
+
+  std::vector<regIndexSlot> slots(nSlots);
+  std::memset(slots.data(), 0, nSlots*sizeof(regIndexSlot));
+  std::string keys(1, '\0'); // offset 0 marks empty slots
+  for (auto it:nodes) {
+    uint32_t hash = regIndexHash(it.first.data(), it.first.size());
+    uint32_t slot = hash & (nSlots-1);
+    while (slots[slot].keyOffset != 0) slot = (slot+1) & (nSlots-1);
+    slots[slot].hash = hash;
+    slots[slot].keyOffset = keys.size();
+    slots[slot].info = serialize(it.second);
+    keys.append(it.first.c_str(), it.first.size()+1);
+  }
+
+  regIndexHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = REG_INDEX_MAGIC;
+  header.nSlots = nSlots;
+  header.nEntries = nodes.size();
+  header.keysOffset = sizeof(header)+nSlots*sizeof(regIndexSlot);
+  header.fileSize = header.keysOffset+keys.size();
+  header.stamp = stamp;
+
+  // Written aside and renamed, processes still mapping the previous index are not disturbed
+  std::string tmp_file = regIndexFile()+".tmp";
+  FILE * f = std::fopen(tmp_file.c_str(), "wb");
+  if (f == nullptr) return false;
+  bool ok = (std::fwrite(&header, sizeof(header), 1, f) == 1);
+  ok = ok && (std::fwrite(slots.data(), sizeof(regIndexSlot), nSlots, f) == nSlots);
+  ok = ok && (std::fwrite(keys.data(), 1, keys.size(), f) == keys.size());
+  ok = (std::fclose(f) == 0) && ok;
+  if (!ok || std::rename(tmp_file.c_str(), regIndexFile().c_str()) != 0) {
+    std::remove(tmp_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+static void unmapRegIndex() {
+  if (at_index != nullptr) munmap((void *)at_index, at_index_size);
+  at_index = nullptr;
+  at_index_size = 0;
+}
+
+static void mapRegIndex(uint64_t stamp) {
+  unmapRegIndex();
+  at_index_ino = 0;
+  int fd = open(regIndexFile().c_str(), O_RDONLY);
+  if (fd < 0) return;
+  struct stat st;
+  if (fstat(fd, &st) == 0) {
+    at_index_ino = st.st_ino;
+    if ((size_t)st.st_size >= sizeof(regIndexHeader)) {
+      void * map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (map != MAP_FAILED) {
+        at_index = (const char *)map;
+        at_index_size = st.st_size;
+      }
+    }
+  }
+  close(fd);
+  if (at_index == nullptr) return;
+
+  const regIndexHeader * header = (const regIndexHeader *)at_index;
+  if (header->magic != REG_INDEX_MAGIC || header->fileSize != at_index_size || header->stamp != stamp
+      || header->keysOffset != sizeof(regIndexHeader)+(size_t)header->nSlots*sizeof(regIndexSlot)) {
+    LOGGER->log_message(LogManager::WARNING, "Register index does not match the address table, it will not be used");
+    unmapRegIndex();
+  }
+}
+
+static const regInfo * lookupRegIndex(const char * key, size_t len) {
+  const regIndexHeader * header = (const regIndexHeader *)at_index;
+  const regIndexSlot * slots = (const regIndexSlot *)(at_index+sizeof(regIndexHeader));
+  const char * keys = at_index+header->keysOffset;
+  uint32_t hash = regIndexHash(key, len);
+  uint32_t slot = hash & (header->nSlots-1);
+  while (slots[slot].keyOffset != 0) {
+    if (slots[slot].hash == hash) {
+      const char * t_key = keys+slots[slot].keyOffset;
+      if (std::memcmp(t_key, key, len) == 0 && t_key[len] == '\0') return &slots[slot].info;
+    }
+    slot = (slot+1) & (header->nSlots-1);
+  }
+  return nullptr;
+}
+
+static lmdb::env *at_env = nullptr; /// \var process-lifetime LMDB environment of the address table
+static lmdb::txn *at_rtxn = nullptr; /// \var cached read-only transaction, reset between RPC calls
+static lmdb::dbi *at_dbi = nullptr; /// \var cached database handle
+static pid_t at_pid = 0; /// \var process which opened the environment, LMDB handles must not be used across fork()
+static dev_t at_dev = 0; /// \var device of the opened data.mdb
+static ino_t at_ino = 0; /// \var inode of the opened data.mdb, changes when update_address_table recreates the database
+static uint32_t at_generation = 0; /// \var incremented every time the environment is (re)opened
+static int at_depth = 0; /// \var number of nested addressTableTxn scopes
+
+static bool addressTableReplaced() {
+  if (at_env == nullptr || at_pid != getpid()) return true;
+  std::string gem_path = std::getenv("GEM_PATH");
+  std::string lmdb_data_file = gem_path+"/address_table.mdb/data.mdb";
+  struct stat st;
+  if (stat(lmdb_data_file.c_str(), &st) != 0) return true;
+  if (st.st_dev != at_dev || st.st_ino != at_ino) return true;
+  ino_t index_ino = (stat(regIndexFile().c_str(), &st) == 0) ? st.st_ino : 0;
+  return (index_ino != at_index_ino);
+}
+
+void closeAddressTable() {
+  if (at_pid == getpid()) {
+    delete at_rtxn;
+    delete at_dbi;
+    delete at_env;
+  }
+  // Handles inherited through fork() belong to the parent and are dropped without being closed
+  at_rtxn = nullptr;
+  at_dbi = nullptr;
+  at_env = nullptr;
+  at_pid = 0;
+  unmapRegIndex();
+}
+
+static void openAddressTableEnv() {
+  if (at_env != nullptr && at_pid != getpid()) {
+    closeAddressTable();
+    at_depth = 0;
+  }
+  if (at_depth > 0 || !addressTableReplaced()) return;
+  closeAddressTable();
+
+  auto env = lmdb::env::create();
+  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
+  std::string gem_path = std::getenv("GEM_PATH");
+  std::string lmdb_data_file = gem_path+"/address_table.mdb";
+  env.open(lmdb_data_file.c_str(), 0, 0664);
+  auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
+  auto dbi = lmdb::dbi::open(rtxn, nullptr);
+  lmdb::val key, db_res;
+  uint64_t stamp = 0;
+  key.assign(REG_INDEX_STAMP_KEY);
+  if (dbi.get(rtxn, key, db_res) && db_res.size() == sizeof(stamp)) std::memcpy(&stamp, db_res.data(), sizeof(stamp));
+  rtxn.reset();
+  mapRegIndex(stamp);
+
+  mdb_filehandle_t fd;
+  struct stat st;
+  if (mdb_env_get_fd(env, &fd) == 0 && fstat(fd, &st) == 0) {
+    at_dev = st.st_dev;
+    at_ino = st.st_ino;
+  }
+  at_env = new lmdb::env(std::move(env));
+  at_rtxn = new lmdb::txn(std::move(rtxn));
+  at_dbi = new lmdb::dbi(std::move(dbi));
+  at_pid = getpid();
+  ++at_generation;
+  LOGGER->log_message(LogManager::INFO, stdsprintf("Address table opened (generation %u)", at_generation));
+}
+
+bool openAddressTable() {
+  try {
+    openAddressTableEnv();
+  } catch (lmdb::error & e) {
+    LOGGER->log_message(LogManager::WARNING, stdsprintf("Unable to open the address table, will retry on first use: %s", e.what()));
+    return false;
+  }
+  return true;
+}
+
+uint32_t getAddressTableGeneration() {
+  return at_generation;
+}
+
+static lmdb::txn & beginAddressTableTxn() {
+  if (at_depth == 0 || at_pid != getpid()) {
+    openAddressTableEnv();
+    at_rtxn->renew();
+  }
+  ++at_depth;
+  return *at_rtxn;
+}
+
+addressTableTxn::addressTableTxn() : rtxn(beginAddressTableTxn()), dbi(*at_dbi) {
+  // The outermost transaction is opened by the RPC method, attribute its register accesses to the module defining it
+  if (at_depth == 1) {
+    Dl_info info;
+    if (dladdr(__builtin_return_address(0), &info) && info.dli_fname) {
+      const char * name = strrchr(info.dli_fname, '/');
+      memhub_set_caller(name ? name+1 : info.dli_fname);
+    }
+  }
+}
+
+addressTableTxn::~addressTableTxn() {
+  if (--at_depth == 0) {
+    rtxn.reset();
+    memhub_set_caller(NULL);
+  }
+}
 
 void update_address_table(const RPCMsg *request, RPCMsg *response) {
   LOGGER->log_message(LogManager::INFO, "START UPDATE ADDRESS TABLE");
@@ -23,8 +279,18 @@ void update_address_table(const RPCMsg *request, RPCMsg *response) {
   m_parsed_at.erase("top");
   xhal::utils::Node t_node;
 
+  // Index is written first, it is only used once the LMDB database holding the same stamp is committed
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  uint64_t stamp = ((uint64_t)now.tv_sec << 32) ^ ((uint64_t)now.tv_nsec << 8) ^ getpid();
+  LOGGER->log_message(LogManager::INFO, "WRITE REGISTER INDEX");
+  if (!writeRegIndex(m_parsed_at, stamp)) {
+    LOGGER->log_message(LogManager::WARNING, "Unable to write the register index, lookups will use LMDB only");
+  }
+
   // Remove old DB
   LOGGER->log_message(LogManager::INFO, "REMOVE OLD DB");
+  closeAddressTable();
   std::remove(lmdb_data_file.c_str());
   std::remove(lmdb_lock_file.c_str());
 
@@ -42,16 +308,19 @@ void update_address_table(const RPCMsg *request, RPCMsg *response) {
   LOGGER->log_message(LogManager::INFO, "START ITERATING OVER MAP");
 
   std::string t_key;
-  std::string t_value;
+  regInfo t_value;
   for (auto it:m_parsed_at)
   {
     t_key = it.first;
     t_node = it.second;
     t_value = serialize(t_node);
     key.assign(t_key);
-    value.assign(t_value);
+    value.assign(&t_value, sizeof(t_value));
     dbi.put(wtxn, key, value);
   }
+  key.assign(REG_INDEX_STAMP_KEY);
+  value.assign(&stamp, sizeof(stamp));
+  dbi.put(wtxn, key, value);
   wtxn.commit();
   LOGGER->log_message(LogManager::INFO, "COMMIT DB");
   wtxn.abort();
@@ -59,38 +328,112 @@ void update_address_table(const RPCMsg *request, RPCMsg *response) {
 
 void readRegFromDB(const RPCMsg *request, RPCMsg *response) {
   std::string regName = request->get_string("reg_name");
-  auto env = lmdb::env::create();
-  env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-  std::string gem_path = std::getenv("GEM_PATH");
-  std::string lmdb_data_file = gem_path+"/address_table.mdb";
-  env.open(lmdb_data_file.c_str(), 0, 0664);
-  LOGGER->log_message(LogManager::INFO, "LMDB ENV OPEN");
+  addressTableTxn atxn;
   lmdb::val key;
   lmdb::val value;
-  auto rtxn = lmdb::txn::begin(env);
-  auto dbi = lmdb::dbi::open(rtxn, nullptr);
   key.assign(regName.c_str());
-  bool found = dbi.get(rtxn,key,value);
-  uint32_t reg_address, reg_mask;
-  std::string permissions;
-  std::vector<std::string> temp;
-  std::string t_value;
-  if (found){
+  bool found = atxn.dbi.get(atxn.rtxn,key,value);
+  regInfo info;
+  if (found && parseRegInfo(value, info)){
 		LOGGER->log_message(LogManager::INFO, stdsprintf("Key: %s is found", regName.c_str()));
-    t_value = std::string(value.data());
-    t_value = t_value.substr(0,value.size());
-    temp = split(t_value,'|');
-    reg_address = stoll(temp[0]);
-    permissions = temp[1];
-    reg_mask = stoll(temp[2]);
+    std::string permissions;
+    if (info.perm & REG_PERM_READ) permissions += "r";
+    if (info.perm & REG_PERM_WRITE) permissions += "w";
     response->set_string("permissions", permissions);
-    response->set_word("address", reg_address);
-    response->set_word("mask", reg_mask);
+    response->set_word("address", info.address);
+    response->set_word("mask", info.mask);
   } else {
 		LOGGER->log_message(LogManager::ERROR, stdsprintf("Key: %s is NOT found", regName.c_str()));
     response->set_string("error", "Register not found");
   }
-  rtxn.abort();
+}
+
+bool parseRegInfo(const lmdb::val & db_res, regInfo & info) {
+  if (db_res.size() == sizeof(regInfo)) {
+    const regInfo * t_info = db_res.data<regInfo>();
+    if (t_info->format == REG_INFO_FORMAT) {
+      info = *t_info;
+      return true;
+    }
+  }
+  // Legacy "addr|perm|mask" string
+  std::string t_db_res = std::string(db_res.data(), db_res.size());
+  std::vector<std::string> tmp = split(t_db_res,'|');
+  if (tmp.size() != 3) return false;
+  char * end;
+  errno = 0;
+  long long address = strtoll(tmp[0].c_str(), &end, 10);
+  if (tmp[0].empty() || *end != '\0' || errno) return false;
+  long long mask = strtoll(tmp[2].c_str(), &end, 10);
+  if (tmp[2].empty() || *end != '\0' || errno) return false;
+  info.address = address;
+  info.mask = mask;
+  info.shift = info.mask ? __builtin_ctz(info.mask) : 0;
+  info.perm = 0;
+  if (tmp[1].find('r') != std::string::npos) info.perm |= REG_PERM_READ;
+  if (tmp[1].find('w') != std::string::npos) info.perm |= REG_PERM_WRITE;
+  info.format = REG_INFO_FORMAT;
+  return true;
+}
+
+bool getRegInfo(localArgs * la, const std::string & regName, regInfo & info) {
+  if (at_index != nullptr) {
+    const regInfo * t_info = lookupRegIndex(regName.data(), regName.size());
+    if (t_info != nullptr) {
+      info = *t_info;
+      return true;
+    }
+  }
+  lmdb::val key, db_res;
+  key.assign(regName.c_str());
+  if (!la->dbi.get(la->rtxn,key,db_res)) return false;
+  return parseRegInfo(db_res, info);
+}
+
+void setWordArray(const RPCMsg *request, RPCMsg *response, const std::string & key, const uint32_t *data, uint32_t count) {
+  if (request->get_key_exists("binaryPayload") && request->get_word("binaryPayload")) {
+    response->set_binarydata(key, data, count*sizeof(uint32_t));
+    response->set_string(key+"_type", "uint32le");
+  } else {
+    response->set_word_array(key, const_cast<uint32_t *>(data), count);
+  }
+}
+
+pid_t forkDetached(volatile pid_t *published) {
+  int fds[2];
+  if (pipe(fds) != 0) return -1;
+  pid_t child = fork();
+  if (child < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  if (child == 0) {
+    // Double fork, so that the worker is reparented to init and is not left as a zombie of the RPC process
+    close(fds[0]);
+    pid_t worker = fork();
+    if (worker == 0) {
+      setsid();
+      // Do not keep the client connection open
+      for (int fd = 3; fd < sysconf(_SC_OPEN_MAX); ++fd) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode)) close(fd);
+      }
+      // The worker publishes its own pid before it starts, so that the caller never overwrites a value the worker already changed
+      pid_t self = getpid();
+      if (published) *published = self;
+      if (write(fds[1], &self, sizeof(self)) != sizeof(self)) _exit(1);
+      close(fds[1]);
+      return 0;
+    }
+    _exit(worker > 0 ? 0 : 1);
+  }
+  close(fds[1]);
+  pid_t worker = -1;
+  if (read(fds[0], &worker, sizeof(worker)) != sizeof(worker)) worker = -1;
+  close(fds[0]);
+  waitpid(child, NULL, 0);
+  return worker;
 }
 
 uint32_t getNumNonzeroBits(uint32_t value){
@@ -106,17 +449,10 @@ uint32_t getNumNonzeroBits(uint32_t value){
 } //End numNonzeroBits()
 
 uint32_t getMask(localArgs * la, const std::string & regName){
-    lmdb::val key, db_res;
-    bool found=false;
-    key.assign(regName.c_str());
-    found = la->dbi.get(la->rtxn,key,db_res);
+    regInfo info;
     uint32_t mask = 0x0;
-    if (found){
-        std::vector<std::string> tmp;
-        std::string t_db_res = std::string(db_res.data());
-        t_db_res = t_db_res.substr(0,db_res.size());
-        tmp = split(t_db_res,'|');
-        mask = stoll(tmp[2]);
+    if (getRegInfo(la, regName, info)){
+        mask = info.mask;
     } else {
         LOGGER->log_message(LogManager::ERROR, stdsprintf("Key: %s is NOT found", regName.c_str()));
         la->response->set_string("error", "Register not found");
@@ -144,46 +480,27 @@ uint32_t readRawAddress(uint32_t address, RPCMsg* response){
 }
 
 uint32_t getAddress(localArgs * la, const std::string & regName){
-  lmdb::val key, db_res;
-  bool found;
-  key.assign(regName.c_str());
-  found = la->dbi.get(la->rtxn,key,db_res);
-  uint32_t address;
-  if (found){
-    std::vector<std::string> tmp;
-    std::string t_db_res = std::string(db_res.data());
-    t_db_res = t_db_res.substr(0,db_res.size());
-    tmp = split(t_db_res,'|');
-    address = stoi(tmp[0]);
-  } else {
+  regInfo info;
+  if (!getRegInfo(la, regName, info)){
     LOGGER->log_message(LogManager::ERROR, stdsprintf("Key: %s is NOT found", regName.c_str()));
     la->response->set_string("error", "Register not found");
     return 0xdeaddead;
   }
-  return address;
+  return info.address;
 }
 
 void writeAddress(lmdb::val & db_res, uint32_t value, RPCMsg *response) {
-  std::vector<std::string> tmp;
-  std::string t_db_res = std::string(db_res.data());
-  t_db_res = t_db_res.substr(0,db_res.size());
-  tmp = split(t_db_res,'|');
-  uint32_t data[1];
-  uint32_t address = stoi(tmp[0]);
-  data[0] = value;
-  if (memhub_write(memsvc, address, 1, data) != 0) {
-  	response->set_string("error", std::string("memsvc error: ")+memsvc_get_last_error(memsvc));
-  	LOGGER->log_message(LogManager::INFO, stdsprintf("write memsvc error: %s", memsvc_get_last_error(memsvc)));
+  regInfo info;
+  if (!parseRegInfo(db_res, info)) {
+    response->set_string("error", "Malformed address table entry");
+    LOGGER->log_message(LogManager::ERROR, "Malformed address table entry");
+    return;
   }
+  writeRawAddress(info.address, value, response);
 }
 
-uint32_t readAddress(lmdb::val & db_res, RPCMsg *response) {
-  std::vector<std::string> tmp;
-  std::string t_db_res = std::string(db_res.data());
-  t_db_res = t_db_res.substr(0,db_res.size());
-  tmp = split(t_db_res,'|');
+static uint32_t readAddressRetry(uint32_t address, RPCMsg *response) {
   uint32_t data[1];
-  uint32_t address = stoi(tmp[0]);
   int n_current_tries = 0;
   while (true)
   {
@@ -206,13 +523,20 @@ uint32_t readAddress(lmdb::val & db_res, RPCMsg *response) {
   return data[0];
 }
 
+uint32_t readAddress(lmdb::val & db_res, RPCMsg *response) {
+  regInfo info;
+  if (!parseRegInfo(db_res, info)) {
+    response->set_string("error", "Malformed address table entry");
+    LOGGER->log_message(LogManager::ERROR, "Malformed address table entry");
+    return 0xdeaddead;
+  }
+  return readAddressRetry(info.address, response);
+}
+
 void writeRawReg(localArgs * la, const std::string & regName, uint32_t value) {
-  lmdb::val key, db_res;
-  bool found;
-  key.assign(regName.c_str());
-  found = la->dbi.get(la->rtxn,key,db_res);
-  if (found){
-    writeAddress(db_res, value, la->response);
+  regInfo info;
+  if (getRegInfo(la, regName, info)){
+    writeRawAddress(info.address, value, la->response);
   } else {
   	LOGGER->log_message(LogManager::ERROR, stdsprintf("Key: %s is NOT found", regName.c_str()));
     la->response->set_string("error", "Register not found");
@@ -220,12 +544,9 @@ void writeRawReg(localArgs * la, const std::string & regName, uint32_t value) {
 }
 
 uint32_t readRawReg(localArgs * la, const std::string & regName) {
-  lmdb::val key, db_res;
-  bool found;
-  key.assign(regName.c_str());
-  found = la->dbi.get(la->rtxn,key,db_res);
-  if (found){
-    return readAddress(db_res, la->response);
+  regInfo info;
+  if (getRegInfo(la, regName, info)){
+    return readAddressRetry(info.address, la->response);
   } else {
   	LOGGER->log_message(LogManager::ERROR, stdsprintf("Key: %s is NOT found", regName.c_str()));
     la->response->set_string("error", "Register not found");
@@ -248,36 +569,33 @@ uint32_t applyMask(uint32_t data, uint32_t mask) {
   return result;
 }
 
+uint32_t readReg(localArgs * la, const regInfo & reg) {
+  if (!(reg.perm & REG_PERM_READ)) {
+    LOGGER->log_message(LogManager::ERROR, stdsprintf("No read permissions for register at %08X", reg.address));
+    return 0xdeaddead;
+  }
+  uint32_t data[1];
+  if (memhub_read(memsvc, reg.address, 1, data) != 0) {
+    la->response->set_string("error", std::string("memsvc error: ")+memsvc_get_last_error(memsvc));
+    LOGGER->log_message(LogManager::ERROR, stdsprintf("read memsvc error: %s", memsvc_get_last_error(memsvc)));
+    return 0xdeaddead;
+  }
+  if (reg.mask!=0xFFFFFFFF) {
+    return (data[0] & reg.mask) >> reg.shift;
+  } else {
+    return data[0];
+  }
+}
+
 uint32_t readReg(localArgs * la, const std::string & regName) {
-  lmdb::val key, db_res;
-  bool found;
-  key.assign(regName.c_str());
-  found = la->dbi.get(la->rtxn,key,db_res);
-  if (found){
-    std::vector<std::string> tmp;
-    std::string t_db_res = std::string(db_res.data());
-    t_db_res = t_db_res.substr(0,db_res.size());
-    tmp = split(t_db_res,'|');
-    std::size_t found = tmp[1].find_first_of("r");
-    if (found==std::string::npos) {
+  regInfo info;
+  if (getRegInfo(la, regName, info)){
+    if (!(info.perm & REG_PERM_READ)) {
     	//response->set_string("error", std::string("No read permissions"));
     	LOGGER->log_message(LogManager::ERROR, stdsprintf("No read permissions for %s", regName.c_str()));
       return 0xdeaddead;
     }
-    uint32_t data[1];
-    uint32_t address,mask;
-    address = stoll(tmp[0]);
-    mask = stoll(tmp[2]);
-    if (memhub_read(memsvc, address, 1, data) != 0) {
-    	//response->set_string("error", std::string("memsvc error: ")+memsvc_get_last_error(memsvc));
-    	LOGGER->log_message(LogManager::ERROR, stdsprintf("read memsvc error: %s", memsvc_get_last_error(memsvc)));
-      return 0xdeaddead;
-    }
-    if (mask!=0xFFFFFFFF) {
-      return applyMask(data[0],mask);
-    } else {
-      return data[0];
-    }
+    return readReg(la, info);
   } else {
   	LOGGER->log_message(LogManager::ERROR, stdsprintf("Key: %s is NOT found", regName.c_str()));
     //response->set_string("error", "Register not found");
@@ -285,48 +603,195 @@ uint32_t readReg(localArgs * la, const std::string & regName) {
   }
 }
 
-void writeReg(localArgs * la, const std::string & regName, uint32_t value) {
-  lmdb::val key, db_res;
-  bool found;
-  key.assign(regName.c_str());
-  found = la->dbi.get(la->rtxn,key,db_res);
-  if (found){
-    std::vector<std::string> tmp;
-    std::string t_db_res = std::string(db_res.data());
-    t_db_res = t_db_res.substr(0,db_res.size());
-    tmp = split(t_db_res,'|');
-    uint32_t mask = stoll(tmp[2]);
-    if (mask==0xFFFFFFFF) {
-      writeAddress(db_res, value, la->response);
-    } else {
-      uint32_t current_value = readAddress(db_res, la->response);
-      if (current_value == 0xdeaddead) {
-  	    la->response->set_string("error", std::string("Writing masked reg failed due to reading problem"));
-  	    LOGGER->log_message(LogManager::ERROR, stdsprintf("Writing masked reg failed due to reading problem: %s", regName.c_str()));
-        return;
-      }
-      int shift_amount = 0;
-      uint32_t mask_copy = mask;
-      for (int i = 0; i < 32; i++)
-      {
-        if (mask & 1)
-        {
-          break;
-        } else {
-          shift_amount +=1;
-          mask = mask >> 1;
-        }
-      }
-      uint32_t val_to_write = value << shift_amount;
-      val_to_write = (val_to_write & mask_copy) | (current_value & ~mask_copy);
-      writeAddress(db_res, val_to_write, la->response);
+void writeReg(localArgs * la, const regInfo & reg, uint32_t value) {
+  if (reg.mask==0xFFFFFFFF) {
+    writeRawAddress(reg.address, value, la->response);
+  } else {
+    uint32_t current_value = readAddressRetry(reg.address, la->response);
+    if (current_value == 0xdeaddead) {
+      la->response->set_string("error", std::string("Writing masked reg failed due to reading problem"));
+      LOGGER->log_message(LogManager::ERROR, stdsprintf("Writing masked reg failed due to reading problem: %08X", reg.address));
+      return;
     }
+    uint32_t val_to_write = value << reg.shift;
+    val_to_write = (val_to_write & reg.mask) | (current_value & ~reg.mask);
+    writeRawAddress(reg.address, val_to_write, la->response);
+  }
+}
+
+void writeReg(localArgs * la, const std::string & regName, uint32_t value) {
+  regInfo info;
+  if (getRegInfo(la, regName, info)){
+    writeReg(la, info, value);
   } else {
   	LOGGER->log_message(LogManager::ERROR, stdsprintf("Key: %s is NOT found", regName.c_str()));
     la->response->set_string("error", "Register not found");
   }
 }
 
+bool getRegArray(localArgs * la, const std::string & prefix, uint32_t size, const std::string & suffix, regArray & arr) {
+  arr.size = size;
+  arr.stride = 0;
+  arr.elements.clear();
+  if (size == 0) return true;
+
+  // Resolve every element, the register index makes the lookups cheap
+  arr.elements.resize(size);
+  for (uint32_t i = 0; i < size; ++i) {
+    std::string regName = prefix+std::to_string(i)+suffix;
+    if (!getRegInfo(la, regName, arr.elements[i])) {
+      LOGGER->log_message(LogManager::ERROR, stdsprintf("Key: %s is NOT found", regName.c_str()));
+      la->response->set_string("error", "Register not found");
+      arr.elements.clear();
+      return false;
+    }
+  }
+  arr.first = arr.elements[0];
+  if (size == 1) {
+    arr.elements.clear();
+    return true;
+  }
+
+  // Keep the compact form only if all elements follow a constant stride
+  arr.stride = arr.elements[1].address-arr.first.address;
+  for (uint32_t i = 1; i < size; ++i) {
+    const regInfo & e = arr.elements[i];
+    if (e.address != arr.first.address+i*arr.stride || e.mask != arr.first.mask || e.perm != arr.first.perm) return true;
+  }
+  arr.elements.clear();
+  return true;
+}
+
+bool getVFATRegArray(localArgs * la, uint32_t ohN, const std::string & regName, regArray & arr) {
+  return getRegArray(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT", ohN), 24, "."+regName, arr);
+}
+
+bool getChannelRegArray(localArgs * la, uint32_t ohN, uint32_t vfatN, const std::string & regName, regArray & arr) {
+  return getRegArray(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL", ohN, vfatN), 128, regName.empty() ? "" : "."+regName, arr);
+}
+
+bool regWait::poll(uint32_t & data) {
+  ++stats.polls;
+  if (!(reg.perm & REG_PERM_READ) || memhub_read(memsvc, reg.address, 1, &data) != 0) {
+    LOGGER->log_message(LogManager::ERROR, stdsprintf("Unable to read register at %08X while waiting for it", reg.address));
+    data = 0xdeaddead;
+    return false;
+  }
+  if (reg.mask != 0xFFFFFFFF) data = (data & reg.mask) >> reg.shift;
+  return true;
+}
+
+void regWait::record(uint64_t elapsedUs, bool done) {
+  ++stats.waits;
+  if (!done) ++stats.timeouts;
+  stats.totalUs += elapsedUs;
+  stats.maxUs = std::max<uint64_t>(stats.maxUs, elapsedUs);
+}
+
+void regWait::report(RPCMsg * response, const std::string & prefix) const {
+  response->set_word(prefix+"Waits", stats.waits);
+  response->set_word(prefix+"Timeouts", stats.timeouts);
+  response->set_word(prefix+"Polls", std::min<uint64_t>(stats.polls, 0xFFFFFFFF));
+  response->set_word(prefix+"TotalUs", std::min<uint64_t>(stats.totalUs, 0xFFFFFFFF));
+  response->set_word(prefix+"MaxUs", stats.maxUs);
+}
+
+size_t regBatch::read(localArgs * la, const std::string & regName, const std::string & key) {
+  regInfo info = {};
+  if (!getRegInfo(la, regName, info)) {
+  	LOGGER->log_message(LogManager::ERROR, stdsprintf("Key: %s is NOT found", regName.c_str()));
+    info.perm = 0;
+  } else if (!(info.perm & REG_PERM_READ)) {
+  	LOGGER->log_message(LogManager::ERROR, stdsprintf("No read permissions for %s", regName.c_str()));
+  }
+  return read(info, key);
+}
+
+size_t regBatch::read(const regInfo & reg, const std::string & key) {
+  entries.push_back({reg, key, false, (reg.perm & REG_PERM_READ) != 0, 0xdeaddead});
+  return entries.size()-1;
+}
+
+size_t regBatch::write(localArgs * la, const std::string & regName, uint32_t value) {
+  regInfo info = {};
+  if (!getRegInfo(la, regName, info)) {
+  	LOGGER->log_message(LogManager::ERROR, stdsprintf("Key: %s is NOT found", regName.c_str()));
+    la->response->set_string("error", "Register not found");
+    entries.push_back({info, "", true, false, value});
+    return entries.size()-1;
+  }
+  return write(info, value);
+}
+
+size_t regBatch::writeRaw(localArgs * la, const std::string & regName, uint32_t value) {
+  regInfo info = {};
+  if (!getRegInfo(la, regName, info)) {
+  	LOGGER->log_message(LogManager::ERROR, stdsprintf("Key: %s is NOT found", regName.c_str()));
+    la->response->set_string("error", "Register not found");
+    entries.push_back({info, "", true, false, value});
+    return entries.size()-1;
+  }
+  info.mask = 0xFFFFFFFF;
+  info.shift = 0;
+  return write(info, value);
+}
+
+size_t regBatch::write(const regInfo & reg, uint32_t value) {
+  entries.push_back({reg, "", true, true, value});
+  return entries.size()-1;
+}
+
+int regBatch::execute(localArgs * la, uint32_t maxHoldUs) {
+  std::vector<memhub_op> ops;
+  std::vector<size_t> opEntry;
+  ops.reserve(entries.size());
+  opEntry.reserve(entries.size());
+  int failed = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    entry & e = entries[i];
+    if (!e.valid) {
+      if (!e.write) e.value = 0xdeaddead;
+      ++failed;
+      continue;
+    }
+    memhub_op op = {MEMHUB_READ, e.reg.address, 0, 0xFFFFFFFF, 0};
+    if (e.write) {
+      if (e.reg.mask == 0xFFFFFFFF) {
+        op.type = MEMHUB_WRITE;
+        op.value = e.value;
+      } else {
+        op.type = MEMHUB_RMW;
+        op.value = e.value << e.reg.shift;
+        op.mask = e.reg.mask;
+      }
+    }
+    ops.push_back(op);
+    opEntry.push_back(i);
+  }
+  if (memhub_batch(memsvc, ops.data(), ops.size(), maxHoldUs) != 0) {
+    LOGGER->log_message(LogManager::ERROR, stdsprintf("batch memsvc error: %s", memsvc_get_last_error(memsvc)));
+  }
+  for (size_t k = 0; k < opEntry.size(); ++k) {
+    entry & e = entries[opEntry[k]];
+    const memhub_op & op = ops[k];
+    if (op.status != 0) {
+      ++failed;
+      if (e.write) {
+        la->response->set_string("error", std::string("memsvc error: ")+memsvc_get_last_error(memsvc));
+        LOGGER->log_message(LogManager::ERROR, stdsprintf("Writing reg %08X failed in batch", e.reg.address));
+      } else {
+        e.value = 0xdeaddead;
+      }
+    } else if (!e.write) {
+      e.value = e.reg.mask == 0xFFFFFFFF ? op.value : (op.value & e.reg.mask) >> e.reg.shift;
+    }
+  }
+  for (auto & e : entries) {
+    if (!e.write && !e.key.empty()) la->response->set_word(e.key, e.value);
+  }
+  return failed;
+}
+
 extern "C" {
 	const char *module_version_key = "utils v1.0.1";
 	int module_activity_color = 4;
@@ -336,6 +801,7 @@ extern "C" {
 			LOGGER->log_message(LogManager::ERROR, "Unable to load module");
 			return; // Do not register our functions, we depend on memsvc.
 		}
+		openAddressTable();
 		modmgr->register_method("utils", "update_address_table", update_address_table);
 		modmgr->register_method("utils", "readRegFromDB", readRegFromDB);
 	}
@@ -6,21 +6,24 @@
  */
 
 #include <algorithm>
-#include <chrono>
 #include "optohybrid.h"
-#include <thread>
 #include "vfat3.h"
+#include <vector>
 #include "amc.h"
 
 uint32_t vfatSyncCheckLocal(localArgs * la, uint32_t ohN)
 {
+    std::string regBase = stdsprintf("GEM_AMC.OH_LINKS.OH%i.VFAT", ohN);
+    regArray linkGoodRegs, syncErrRegs;
+    if (!getRegArray(la, regBase, 24, ".LINK_GOOD", linkGoodRegs) || !getRegArray(la, regBase, 24, ".SYNC_ERR_CNT", syncErrRegs)) {
+        return 0;
+    }
+
     uint32_t goodVFATs = 0;
     for(int vfatN = 0; vfatN < 24; vfatN++)
     {
-        char regBase [100];
-        sprintf(regBase, "GEM_AMC.OH_LINKS.OH%i.VFAT%i",ohN, vfatN);
-        bool linkGood = readReg(la, std::string(regBase)+".LINK_GOOD");
-        uint32_t linkErrors = readReg(la, std::string(regBase)+".SYNC_ERR_CNT");
+        bool linkGood = readReg(la, linkGoodRegs.at(vfatN));
+        uint32_t linkErrors = readReg(la, syncErrRegs.at(vfatN));
         goodVFATs = goodVFATs | ((linkGood && (linkErrors == 0)) << vfatN);
     }
 
@@ -29,17 +32,11 @@ uint32_t vfatSyncCheckLocal(localArgs * la, uint32_t ohN)
 
 void vfatSyncCheck(const RPCMsg *request, RPCMsg *response)
 {
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     uint32_t goodVFATs = vfatSyncCheckLocal(&la, ohN);
 
     response->set_word("goodVFATs", goodVFATs);
@@ -48,6 +45,11 @@ void vfatSyncCheck(const RPCMsg *request, RPCMsg *response)
 }
 
 void configureVFAT3DacMonitorLocal(localArgs *la, uint32_t ohN, uint32_t mask, uint32_t dacSelect){
+    if (ohN >= 12) {
+        la->response->set_string("error", stdsprintf("Invalid ohN %i, at most 12 optohybrids are supported", ohN));
+        return;
+    }
+
     //Check if VFATs are sync'd
     uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
     uint32_t notmask = ~mask & 0xFFFFFF;
@@ -59,12 +61,19 @@ void configureVFAT3DacMonitorLocal(localArgs *la, uint32_t ohN, uint32_t mask, u
 
     //Get ref voltage and monitor gain
     //These should have been set at time of configure
-    uint32_t adcVRefValues[24];
-    uint32_t monitorGainValues[24];
-    broadcastReadLocal(la, adcVRefValues, ohN, "CFG_VREF_ADC", mask);
-    broadcastReadLocal(la, monitorGainValues, ohN, "CFG_MON_GAIN", mask);
+    uint32_t vfatMasks[12];
+    std::fill(vfatMasks, vfatMasks+12, 0xFFFFFF);
+    vfatMasks[ohN] = mask;
+    uint32_t cfgValues[2*12*24]; //[reg][oh][vfat]
+    if (!broadcastReadMultiLocal(la, cfgValues, 0x1 << ohN, {"CFG_VREF_ADC", "CFG_MON_GAIN"}, vfatMasks)) return;
+    const uint32_t *adcVRefValues = cfgValues + ohN*24;
+    const uint32_t *monitorGainValues = cfgValues + (12 + ohN)*24;
+
+    regArray cfg4Regs;
+    if (!getVFATRegArray(la, ohN, "CFG_4", cfg4Regs)) return;
 
     //Loop over all vfats and set the dacSelect
+    regBatch batch;
     for(int vfatN=0; vfatN<24; ++vfatN){
         // Check if vfat is masked
         if(!((notmask >> vfatN) & 0x1)){
@@ -73,26 +82,21 @@ void configureVFAT3DacMonitorLocal(localArgs *la, uint32_t ohN, uint32_t mask, u
 
         //Build global control 4 register
         uint32_t glbCtr4 = (adcVRefValues[vfatN] << 8) + (monitorGainValues[vfatN] << 7) + dacSelect;
-        writeReg(la, stdsprintf("GEM_AMC.OH.OH%i.GEB.VFAT%i.CFG_4",ohN,vfatN), glbCtr4);
+        batch.write(cfg4Regs.at(vfatN), glbCtr4);
     } //End loop over all VFATs
+    batch.execute(la);
 
     return;
 } //End configureVFAT3DacMonitorLocal(...)
 
 void configureVFAT3DacMonitor(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t vfatMask = request->get_word("vfatMask");
     uint32_t dacSelect = request->get_word("dacSelect");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
 
     LOGGER->log_message(LogManager::INFO, stdsprintf("Programming VFAT3 ADC Monitoring for Selection %i",dacSelect));
     configureVFAT3DacMonitorLocal(&la, ohN, vfatMask, dacSelect);
@@ -101,19 +105,13 @@ void configureVFAT3DacMonitor(const RPCMsg *request, RPCMsg *response){
 } //End configureVFAT3DacMonitor()
 
 void configureVFAT3DacMonitorMultiLink(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     uint32_t ohMask = request->get_word("ohMask");
     uint32_t dacSelect = request->get_word("dacSelect");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
-    unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
+    unsigned int NOH = getFwCapabilities(&la).numOfOH;
     if (request->get_key_exists("NOH")){
         unsigned int NOH_requested = request->get_word("NOH");
         if (NOH_requested <= NOH)
@@ -182,82 +180,134 @@ void configureVFAT3sLocal(localArgs * la, uint32_t ohN, uint32_t vfatMask) {
 }
 
 void configureVFAT3s(const RPCMsg *request, RPCMsg *response) {
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
     uint32_t ohN = request->get_word("ohN");
     uint32_t vfatMask = request->get_word("vfatMask");
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     configureVFAT3sLocal(&la, ohN, vfatMask);
-    rtxn.abort();
 }
 
 void getChannelRegistersVFAT3(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
     LOGGER->log_message(LogManager::INFO, "Getting VFAT3 Channel Registers");
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t vfatMask = request->get_word("vfatMask");
+    bool blockRead = request->get_key_exists("blockRead") && request->get_word("blockRead");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     uint32_t chanRegData[24*128];
 
-    getChannelRegistersVFAT3Local(&la, ohN, vfatMask, chanRegData);
+    getChannelRegistersVFAT3Local(&la, ohN, vfatMask, chanRegData, blockRead);
 
-    response->set_word_array("chanRegData",chanRegData,24*128);
+    setWordArray(request, response, "chanRegData", chanRegData, 24*128);
 
     return;
 } //End getChannelRegistersVFAT3()
 
-void getChannelRegistersVFAT3Local(localArgs *la, uint32_t ohN, uint32_t vfatMask, uint32_t *chanRegData){
+void getChannelRegistersVFAT3Local(localArgs *la, uint32_t ohN, uint32_t vfatMask, uint32_t *chanRegData, bool blockRead){
     //Determine the inverse of the vfatmask
     uint32_t notmask = ~vfatMask & 0xFFFFFF;
 
     char regBuf[200];
-    LOGGER->log_message(LogManager::INFO, "Read channel register settings");
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Read channel register settings of OH%i", ohN));
+
+    //Check if the unmasked VFATs are sync'd
+    uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
+    for(int vfatN=0; vfatN < 24; ++vfatN){
+        if( ((notmask >> vfatN) & 0x1) && !( (goodVFATs >> vfatN ) & 0x1 ) ){
+            sprintf(regBuf,"The requested VFAT is not synced; goodVFATs: %x\t requested VFAT: %i; maskOh: %x", goodVFATs, vfatN, vfatMask);
+            la->response->set_string("error",regBuf);
+            return;
+        }
+    }
+
+    //By default each channel register is read on its own, 200 us apart.
+    //With blockRead the channel registers of a VFAT are read as one block if they are consecutive words, without pacing:
+    //each read returns once its transaction is done, and the memhub lock is handed over to other clients every MEMHUB_DEFAULT_MAX_HOLD_US.
+    //The block read has not been validated on hardware yet, and the checkSbit* scans write this dump back to all the channels
+    std::vector<memhub_run> runs;
+    bool readFailed = false;
     for(int vfatN=0; vfatN < 24; ++vfatN){
         // Check if vfat is masked
         if(!((notmask >> vfatN) & 0x1)){
             continue;
         } //End check if VFAT is masked
 
-        // Check if vfatN is sync'd
-        uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
-        if( !( (goodVFATs >> vfatN ) & 0x1 ) ){
-            sprintf(regBuf,"The requested VFAT is not synced; goodVFATs: %x\t requested VFAT: %i; maskOh: %x", goodVFATs, vfatN, vfatMask);
-            la->response->set_string("error",regBuf);
+        regArray chanRegs;
+        if (!getChannelRegArray(la, ohN, vfatN, "", chanRegs)) return;
+        if (!blockRead) {
+            for(int chan=0; chan < 128; ++chan){
+                uint32_t *data = chanRegData + vfatN*128 + chan;
+                if (memhub_read(memsvc, chanRegs.at(chan).address, 1, data) != 0) {
+                    *data = 0xdeaddead;
+                    readFailed = true;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            continue;
+        }
+        //Addresses are byte addresses: the 128 channels are one block if they are consecutive words
+        if (chanRegs.elements.empty() && chanRegs.stride == sizeof(uint32_t)) {
+            runs.push_back({chanRegs.first.address, 128, chanRegData + vfatN*128, 0});
+        } else {
+            for(int chan=0; chan < 128; ++chan){
+                runs.push_back({chanRegs.at(chan).address, 1, chanRegData + vfatN*128 + chan, 0});
+            }
+        }
+    } //End Loop over VFATs
+
+    if (!runs.empty() && memhub_read_runs(memsvc, runs.data(), runs.size(), MEMHUB_DEFAULT_MAX_HOLD_US) != 0) {
+        for (auto & run : runs) {
+            if (run.status != 0) std::fill(run.data, run.data + run.words, 0xdeaddead);
+        }
+        readFailed = true;
+    }
+    if (readFailed) la->response->set_string("error", stdsprintf("Error reading the channel registers of OH%i", ohN));
+
+    return;
+} //end getChannelRegistersVFAT3Local()
+
+void getChannelRegistersVFAT3MultiLink(const RPCMsg *request, RPCMsg *response){
+    addressTableTxn atxn;
+
+    uint32_t ohMask = request->get_word("ohMask");
+    bool blockRead = request->get_key_exists("blockRead") && request->get_word("blockRead");
+    uint32_t ohVfatMaskArray[12];
+    bool haveVfatMasks = request->get_key_exists("ohVfatMaskArray");
+    if (haveVfatMasks) {
+        if (request->get_word_array_size("ohVfatMaskArray") != 12) {
+            response->set_string("error", "ohVfatMaskArray must have 12 words");
             return;
         }
+        request->get_word_array("ohVfatMaskArray", ohVfatMaskArray);
+    }
 
-        //Loop over the channels
-        uint32_t chanAddr;
-        for(int chan=0; chan < 128; ++chan){
-            //Deterime the idx
-            int idx = vfatN*128 + chan;
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
+    unsigned int NOH = getFwCapabilities(&la).numOfOH;
+    if (request->get_key_exists("NOH")){
+        unsigned int NOH_requested = request->get_word("NOH");
+        if (NOH_requested <= NOH)
+            NOH = NOH_requested;
+        else
+            LOGGER->log_message(LogManager::WARNING, stdsprintf("NOH requested (%i) > NUM_OF_OH AMC register value (%i), NOH request will be disregarded",NOH_requested,NOH));
+    }
 
-            //Get the address
-            sprintf(regBuf,"GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i",ohN,vfatN,chan);
-            chanAddr = getAddress(la, regBuf);
+    std::vector<uint32_t> chanRegDataAll(12*24*128, 0);
+    for(unsigned int ohN=0; ohN<NOH && ohN<12; ++ohN){
+        // If this Optohybrid is masked skip it
+        if(!((ohMask >> ohN) & 0x1)){
+            continue;
+        }
 
-            //Build the channel register
-            LOGGER->log_message(LogManager::INFO, stdsprintf("Reading channel register for VFAT%i chan %i",vfatN,chan));
-            chanRegData[idx] = readRawAddress(chanAddr, la->response);
-            std::this_thread::sleep_for(std::chrono::microseconds(200));
-        } //End Loop over channels
-    } //End Loop over VFATs
+        uint32_t vfatMask = haveVfatMasks ? ohVfatMaskArray[ohN] : getOHVFATMaskLocal(&la, ohN);
+        getChannelRegistersVFAT3Local(&la, ohN, vfatMask, chanRegDataAll.data() + ohN*24*128, blockRead);
+    } //End Loop over all Optohybrids
+
+    setWordArray(request, response, "chanRegDataAll", chanRegDataAll.data(), chanRegDataAll.size());
 
     return;
-} //end getChannelRegistersVFAT3Local()
+} //End getChannelRegistersVFAT3MultiLink()
 
 void readVFAT3ADCLocal(localArgs * la, uint32_t * outData, uint32_t ohN, bool useExtRefADC, uint32_t mask){
     if(useExtRefADC){ //Case: Use ADC with external reference
@@ -271,19 +321,13 @@ void readVFAT3ADCLocal(localArgs * la, uint32_t * outData, uint32_t ohN, bool us
 } //End readVFAT3ADCLocal
 
 void readVFAT3ADC(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     uint32_t ohN = request->get_word("ohN");
     bool useExtRefADC = request->get_word("useExtRefADC");
     uint32_t vfatMask = request->get_word("vfatMask");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     uint32_t adcData[24];
 
     LOGGER->log_message(LogManager::INFO, stdsprintf("Reading VFAT3 ADC's for OH%i with mask %x",ohN, vfatMask));
@@ -295,19 +339,13 @@ void readVFAT3ADC(const RPCMsg *request, RPCMsg *response){
 } //End getChannelRegistersVFAT3()
 
 void readVFAT3ADCMultiLink(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
 
     uint32_t ohMask = request->get_word("ohMask");
     bool useExtRefADC = request->get_word("useExtRefADC");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
-    unsigned int NOH = readReg(&la, "GEM_AMC.GEM_SYSTEM.CONFIG.NUM_OF_OH");
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
+    unsigned int NOH = getFwCapabilities(&la).numOfOH;
     if (request->get_key_exists("NOH")){
         unsigned int NOH_requested = request->get_word("NOH");
         if (NOH_requested <= NOH)
@@ -345,35 +383,47 @@ void setChannelRegistersVFAT3SimpleLocal(localArgs * la, uint32_t ohN, uint32_t
     uint32_t notmask = ~vfatMask & 0xFFFFFF;
 
     char regBuf[200];
-    LOGGER->log_message(LogManager::INFO, "Write channel register settings");
-    for(int vfatN=0; vfatN < 24; ++vfatN){
-        // Check if vfat is masked
-        if(!((notmask >> vfatN) & 0x1)){
-            continue;
-        } //End check if VFAT is masked
+    LOGGER->log_message(LogManager::INFO, stdsprintf("Write channel register settings of OH%i", ohN));
 
-        // Check if vfatN is sync'd
-        uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
-        if( !( (goodVFATs >> vfatN ) & 0x1 ) ){
+    //Check if the unmasked VFATs are sync'd
+    uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
+    for(int vfatN=0; vfatN < 24; ++vfatN){
+        if( ((notmask >> vfatN) & 0x1) && !( (goodVFATs >> vfatN ) & 0x1 ) ){
             sprintf(regBuf,"The requested VFAT is not synced; goodVFATs: %x\t requested VFAT: %i; maskOh: %x", goodVFATs, vfatN, vfatMask);
             la->response->set_string("error",regBuf);
             return;
         }
+    }
 
-        //Loop over the channels
-        uint32_t chanAddr;
-        for(int chan=0; chan < 128; ++chan){
-            //Deterime the idx
-            int idx = vfatN*128 + chan;
+    //Queue the channel words of all the unmasked VFATs
+    std::vector<memhub_op> ops;
+    std::vector<int> opVFAT;
+    ops.reserve(24*128);
+    opVFAT.reserve(24*128);
+    for(int vfatN=0; vfatN < 24; ++vfatN){
+        // Check if vfat is masked
+        if(!((notmask >> vfatN) & 0x1)){
+            continue;
+        } //End check if VFAT is masked
 
-            //Get the address
-            sprintf(regBuf,"GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i",ohN,vfatN,chan);
-            chanAddr = getAddress(la, regBuf);
-            writeRawAddress(chanAddr, chanRegData[idx], la->response);
-            std::this_thread::sleep_for(std::chrono::microseconds(200));
-        } //End Loop over channels
+        regArray chanRegs;
+        if (!getChannelRegArray(la, ohN, vfatN, "", chanRegs)) return;
+        for(int chan=0; chan < 128; ++chan){
+            ops.push_back({MEMHUB_WRITE, chanRegs.at(chan).address, chanRegData[vfatN*128 + chan], 0xFFFFFFFF, 0});
+            opVFAT.push_back(vfatN);
+        }
     } //End Loop over VFATs
 
+    //Stream the words back to back: a write to a VFAT register only returns once the slow control transaction is acknowledged,
+    //so the link paces the writes by itself. The memhub lock is handed over to other clients every MEMHUB_DEFAULT_MAX_HOLD_US
+    if (memhub_batch(memsvc, ops.data(), ops.size(), MEMHUB_DEFAULT_MAX_HOLD_US) != 0) {
+        uint32_t failedVFATs = 0;
+        for (size_t i = 0; i < ops.size(); ++i) {
+            if (ops[i].status != 0) failedVFATs |= 0x1 << opVFAT[i];
+        }
+        la->response->set_string("error", stdsprintf("Channel register writes failed on OH%i for VFATs %x", ohN, failedVFATs));
+    }
+
     return;
 } //End setChannelRegistersVFAT3SimpleLocal()
 
@@ -381,33 +431,19 @@ void setChannelRegistersVFAT3Local(localArgs * la, uint32_t ohN, uint32_t vfatMa
     //Determine the inverse of the vfatmask
     uint32_t notmask = ~vfatMask & 0xFFFFFF;
 
+    //Check all the trim values and build the channel registers before writing any of them
     char regBuf[200];
-    LOGGER->log_message(LogManager::INFO, "Write channel register settings");
+    std::vector<uint32_t> chanRegData(24*128, 0);
     for(int vfatN=0; vfatN < 24; ++vfatN){
         // Check if vfat is masked
         if(!((notmask >> vfatN) & 0x1)){
             continue;
         } //End check if VFAT is masked
 
-        // Check if vfatN is sync'd
-        uint32_t goodVFATs = vfatSyncCheckLocal(la, ohN);
-        if( !( (goodVFATs >> vfatN ) & 0x1 ) ){
-            sprintf(regBuf,"The requested VFAT is not synced; goodVFATs: %x\t requested VFAT: %i; maskOh: %x", goodVFATs, vfatN, vfatMask);
-            la->response->set_string("error",regBuf);
-            return;
-        }
-
-        //Loop over the channels
-        uint32_t chanAddr;
-        uint32_t chanRegVal;
         for(int chan=0; chan < 128; ++chan){
             //Deterime the idx
             int idx = vfatN*128 + chan;
 
-            //Get the address
-            sprintf(regBuf,"GEM_AMC.OH.OH%i.GEB.VFAT%i.VFAT_CHANNELS.CHANNEL%i",ohN,vfatN,chan);
-            chanAddr = getAddress(la, regBuf);
-
             //Check trim values make sense
             if ( trimARM[idx] > 0x3F || trimARM[idx] < 0x0){
                 sprintf(regBuf,"arming comparator trim value must be positive in range [0x0,0x3F]. Value given for VFAT%i chan %i: %x",vfatN,chan,trimARM[idx]);
@@ -421,32 +457,25 @@ void setChannelRegistersVFAT3Local(localArgs * la, uint32_t ohN, uint32_t vfatMa
             }
 
             //Build the channel register
-            LOGGER->log_message(LogManager::INFO, stdsprintf("Setting channel register for VFAT%i chan %i",vfatN,chan));
-            chanRegVal = (calEnable[idx] << 15) + (masks[idx] << 14) + \
-                         (trimZCCPol[idx] << 13) + (trimZCC[idx] << 7) + \
-                         (trimARMPol[idx] << 6) + (trimARM[idx]);
-            writeRawAddress(chanAddr, chanRegVal, la->response);
-            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            chanRegData[idx] = (calEnable[idx] << 15) + (masks[idx] << 14) + \
+                               (trimZCCPol[idx] << 13) + (trimZCC[idx] << 7) + \
+                               (trimARMPol[idx] << 6) + (trimARM[idx]);
         } //End Loop over channels
     } //End Loop over VFATs
 
+    setChannelRegistersVFAT3SimpleLocal(la, ohN, vfatMask, chanRegData.data());
+
     return;
 } //end setChannelRegistersVFAT3Local()
 
 void setChannelRegistersVFAT3(const RPCMsg *request, RPCMsg *response){
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
     LOGGER->log_message(LogManager::INFO, "Setting VFAT3 Channel Registers");
 
     uint32_t ohN = request->get_word("ohN");
     uint32_t vfatMask = request->get_word("vfatMask");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     if (request->get_key_exists("simple")){
         uint32_t chanRegData[3072];
 
@@ -507,6 +536,7 @@ void statusVFAT3sLocal(localArgs * la, uint32_t ohN)
                            "CFG_BIAS_SD_I_BFCAS",
                            "CFG_RUN"};
     std::string regName;
+    regBatch batch;
 
     for(int vfatN = 0; vfatN < 24; vfatN++)
     {
@@ -514,25 +544,19 @@ void statusVFAT3sLocal(localArgs * la, uint32_t ohN)
         sprintf(regBase, "GEM_AMC.OH_LINKS.OH%i.VFAT%i.",ohN, vfatN);
         for (auto &reg : regs) {
             regName = std::string(regBase)+reg;
-            la->response->set_word(regName,readReg(la,regName));
+            batch.read(la,regName,regName);
         }
     }
+    batch.execute(la);
 }
 
 void statusVFAT3s(const RPCMsg *request, RPCMsg *response) {
-    auto env = lmdb::env::create();
-    env.set_mapsize(1UL * 1024UL * 1024UL * 40UL); /* 40 MiB */
-    std::string gem_path = std::getenv("GEM_PATH");
-    std::string lmdb_data_file = gem_path+"/address_table.mdb";
-    env.open(lmdb_data_file.c_str(), 0, 0664);
-    auto rtxn = lmdb::txn::begin(env, nullptr, MDB_RDONLY);
-    auto dbi = lmdb::dbi::open(rtxn, nullptr);
+    addressTableTxn atxn;
     uint32_t ohN = request->get_word("ohN");
     LOGGER->log_message(LogManager::INFO, "Reading VFAT3 status");
 
-    struct localArgs la = {.rtxn = rtxn, .dbi = dbi, .response = response};
+    struct localArgs la = {.rtxn = atxn.rtxn, .dbi = atxn.dbi, .response = response};
     statusVFAT3sLocal(&la, ohN);
-    rtxn.abort();
 }
 
 extern "C" {
@@ -544,10 +568,12 @@ extern "C" {
             LOGGER->log_message(LogManager::ERROR, "Unable to load module");
             return; // Do not register our functions, we depend on memsvc.
         }
+        openAddressTable();
         modmgr->register_method("vfat3", "configureVFAT3s", configureVFAT3s);
         modmgr->register_method("vfat3", "configureVFAT3DacMonitor", configureVFAT3DacMonitor);
         modmgr->register_method("vfat3", "configureVFAT3DacMonitorMultiLink", configureVFAT3DacMonitorMultiLink);
         modmgr->register_method("vfat3", "getChannelRegistersVFAT3", getChannelRegistersVFAT3);
+        modmgr->register_method("vfat3", "getChannelRegistersVFAT3MultiLink", getChannelRegistersVFAT3MultiLink);
         modmgr->register_method("vfat3", "readVFAT3ADC", readVFAT3ADC);
         modmgr->register_method("vfat3", "readVFAT3ADCMultiLink", readVFAT3ADCMultiLink);
         modmgr->register_method("vfat3", "setChannelRegistersVFAT3", setChannelRegistersVFAT3);